@@ -25,6 +25,25 @@ struct MaterialProperty {
     sampler2D sampler;
 };
 
+// lighting.c builds variants of this shader with POINT_LIGHTS,
+// DIR_LIGHTS and SPECULAR defined after the version line, the light
+// count and types are then fixed and there's no per light branching,
+// without them it's the generic rlights version
+#ifdef POINT_LIGHTS
+
+#if POINT_LIGHTS > 0
+uniform vec3 pointPos[POINT_LIGHTS];
+uniform vec4 pointColor[POINT_LIGHTS];
+#endif
+#if DIR_LIGHTS > 0
+uniform vec3 dirDir[DIR_LIGHTS];    // pointing towards the light
+uniform vec4 dirColor[DIR_LIGHTS];
+#endif
+
+#else
+
+#define     SPECULAR                1
+
 struct Light {
     int enabled;
     int type;
@@ -33,11 +52,27 @@ struct Light {
     vec4 color;
 };
 
-// Input lighting values
 uniform Light lights[MAX_LIGHTS];
+
+#endif
+
+// Input lighting values
 uniform vec4 ambient;
 uniform vec3 viewPos;
 
+void addLight(vec3 light, vec3 color, vec3 normal, vec3 viewD,
+                inout vec3 lightDot, inout vec3 specular)
+{
+    float NdotL = max(dot(normal, light), 0.0);
+    lightDot += color * NdotL;
+#if SPECULAR
+    float specCo = 0.0;
+    if(NdotL > 0.0)
+        specCo = pow(max(0.0, dot(viewD, reflect(-(light), normal))), 16);//16 =shine
+    specular += specCo;
+#endif
+}
+
 void main()
 {
     // Texel color fetching from texture sampler
@@ -49,6 +84,21 @@ void main()
 
     // NOTE: Implement here your fragment shader code
 
+#ifdef POINT_LIGHTS
+#if POINT_LIGHTS > 0
+    for (int i = 0; i < POINT_LIGHTS; i++)
+    {
+        addLight(normalize(pointPos[i] - fragPosition), pointColor[i].rgb,
+                    normal, viewD, lightDot, specular);
+    }
+#endif
+#if DIR_LIGHTS > 0
+    for (int i = 0; i < DIR_LIGHTS; i++)
+    {
+        addLight(dirDir[i], dirColor[i].rgb, normal, viewD, lightDot, specular);
+    }
+#endif
+#else
     for (int i = 0; i < MAX_LIGHTS; i++)
     {
         if (lights[i].enabled == 1)
@@ -60,18 +110,13 @@ void main()
             if (lights[i].type == LIGHT_POINT) {
                 light = normalize(lights[i].position - fragPosition);
             }
-            float NdotL = max(dot(normal, light), 0.0);
-            lightDot += lights[i].color.rgb * NdotL;
-
-            float specCo = 0.0;
-            if(NdotL > 0.0)
-                specCo = pow(max(0.0, dot(viewD, reflect(-(light), normal))), 16);//16 =shine
-            specular += specCo;
-
+            addLight(light, lights[i].color.rgb, normal, viewD, lightDot, specular);
         }
     }
+#endif
 
-    finalColor =  (texelColor * ((colDiffuse+vec4(specular,1)) * vec4(lightDot, 1.0)));
+    // fragColor is white unless the vertex or instance is tinted
+    finalColor =  (texelColor * ((colDiffuse*fragColor+vec4(specular,1)) * vec4(lightDot, 1.0)));
     finalColor += texelColor * (ambient/10.0);
     // gamma
     finalColor = pow(finalColor, vec4(1.0/2.2));
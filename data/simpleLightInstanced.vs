@@ -0,0 +1,46 @@
+#version 330
+
+// Input vertex attributes
+in vec3 vertexPosition;
+in vec2 vertexTexCoord;
+in vec3 vertexNormal;
+in vec4 vertexColor;
+
+// per instance, not a matrix but four vec4s the model
+// matrix is built from, position, rotation quaternion
+// (x,y,z,w), scale and tint
+in mat4 instanceTransform;
+
+// Input uniform values
+uniform mat4 mvp;
+
+// Output vertex attributes (to fragment shader)
+out vec2 fragTexCoord;
+out vec4 fragColor;
+out vec3 fragPosition;
+out vec3 fragNormal;
+
+// NOTE: Add here your custom variables
+
+vec3 rotate(vec4 q, vec3 v)
+{
+    return v + 2.0*cross(q.xyz, cross(q.xyz, v) + q.w*v);
+}
+
+void main()
+{
+    vec3 pos = instanceTransform[0].xyz;
+    vec4 rot = instanceTransform[1];
+    vec3 scale = instanceTransform[2].xyz;
+
+    // Send vertex attributes to fragment shader
+    fragTexCoord = vertexTexCoord;
+    fragColor = vertexColor*instanceTransform[3];
+    fragPosition = pos + rotate(rot, vertexPosition*scale);
+    // rotation and scale only so no inverse needed
+    fragNormal = normalize(rotate(rot, vertexNormal/scale));
+
+    // Calculate final vertex position, for instanced draws
+    // mvp is just view projection
+    gl_Position = mvp*vec4(fragPosition, 1.0);
+}
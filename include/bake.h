@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) 2021 Chris Camacho (codifies -  http://bedroomcoders.co.uk/)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+// meshes baked from obj files into a binary that's mapped straight
+// into memory at startup, no text to parse and no welding, a mesh
+// can carry the welded positions and indices for its collision too
+// include after raylibODE.h
+
+typedef struct bakedMesh {
+    void* map;              // the whole file
+    size_t size;
+    
+    // indexed for rendering, vertices split where normals or uvs do
+    int vertexCount, triangleCount;
+    const float* vertices;
+    const float* normals;
+    const float* texcoords;
+    const unsigned short* indices;
+    
+    // positions only, ready for dGeomTriMeshDataBuildSingle
+    int colVertexCount, colIndexCount;
+    const float* colVertices;
+    const int* colIndices;
+} bakedMesh;
+
+bool bakeObj(const char* objFile, const char* bakeFile, bool collision);
+bakedMesh* loadBaked(const char* bakeFile, const char* sourceFile);
+Mesh bakedRenderMesh(const bakedMesh* baked);
+void freeBaked(bakedMesh* baked);
@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) 2021 Chris Camacho (codifies -  http://bedroomcoders.co.uk/)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+// lighting shaders specialised to the lights actually in use, the
+// count and type of the enabled lights and whether there's specular
+// are compiled into each variant as defines, variants are built the
+// first time a light set needs one and kept for when it comes back
+// include after raylib.h and rlights.h
+
+#define MAX_SHADER_VARIANTS 16
+
+typedef struct shaderVariant {
+    int key;
+    Shader shader;
+} shaderVariant;
+
+typedef struct lightingShader {
+    char* vsText;
+    char* fsText;
+    bool instanced;             // model matrix is an instance attribute
+    Vector4 ambient;
+    shaderVariant variants[MAX_SHADER_VARIANTS];
+    int count;
+    Shader current;
+} lightingShader;
+
+lightingShader* loadLightingShader(const char* vsFile, const char* fsFile, bool instanced, Vector4 ambient);
+Shader selectLighting(lightingShader* ls, const Light* lights, int count, bool specular);
+void unloadLightingShader(lightingShader* ls);
@@ -0,0 +1,47 @@
+/*
+ * Copyright (c) 2021 Chris Camacho (codifies -  http://bedroomcoders.co.uk/)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+// a small frame profiler, stage times are added to the current
+// frame and the last PROF_FRAMES frames are kept for the graph,
+// percentiles and dumps
+
+// stages are drawn stacked in this order
+enum { PROF_GAME, PROF_COLLIDE, PROF_QUICKSTEP, PROF_JOINTEMPTY, 
+        PROF_TRANSFORMS, PROF_DRAW, PROF_STAGES };
+
+#define PROF_FRAMES 240
+
+typedef struct profFrame {
+    double start;               // clock when the frame began
+    double total;               // until the next frame began
+    double stage[PROF_STAGES];  // time spent in each stage
+} profFrame;
+
+double getClock(void);
+void profNextFrame(void);
+void profAdd(int stage, double seconds);
+double profStage(int stage);
+void profPercentiles(int stage, float* p50, float* p95, float* p99);
+void drawProfiler(int x, int y, int width, int height);
+bool saveProfileCSV(const char* fileName);
+bool saveProfileTrace(const char* fileName);
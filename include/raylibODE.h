@@ -33,25 +33,176 @@ extern Model ball;
 extern Model box;
 extern Model cylinder;
 
+// everything that shapes a car, see defaultVehicleParams
+typedef struct vehicleParams {
+    Vector3 position;       // where the chassis starts
+    Vector3 chassis;        // size of the chassis box
+    float chassisMass;
+    float counterWeightMass, counterWeightRadius;
+    float counterWeightDrop;    // how far below the chassis it hangs
+    float wheelRadius, wheelWidth, wheelMass;
+    float wheelBase;        // front to rear axle
+    float trackWidth;       // left to right wheel centres
+    float wheelDrop;        // wheel centres below the chassis
+    float steerLimit;       // radians either way
+    float steerForce, driveForce;
+    float suspensionERP, suspensionCFM;
+    
+    // a ray for each wheel instead of a wheel body and hinge2
+    bool raycast;
+    float springRate, springDamping;    // per wheel, N/m and N/(m/s)
+    float tyreStiffness;    // N per m/s of slip
+    float tyreGrip;         // most tyre force for the load on it
+} vehicleParams;
+
 // 0 chassis / 1-4 wheel / 5 anti roll counter weight
+// a raycast car has no wheel bodies or hinge2 joints, its wheel geoms
+// are only drawn and ride on the chassis where the rays put them
 typedef struct vehicle {
     dBodyID bodies[6];
     dGeomID geoms[6];
     dJointID joints[6];
+    vehicleParams params;
+    dReal wheelOffsets[4][3];   // relative to the chassis
+    
+    // last values given to the drive motors
+    bool driven;
+    float accel, driveTarget;
+    
+    // far away the whole car is one rigid kinematic rig, see
+    // setVehicleKinematic, the wheels and counter weight stay
+    // where they were relative to the chassis when it switched
+    bool kinematic;
+    float speed;            // along the chassis forward
+    float ride;             // chassis height above the ground, NAN until known
+    dReal rigPos[5][3];
+    dQuaternion rigQ[5];
+    
+    // raycast wheels, they only see the ground
+    dSpaceID groundSpace;
+    dGeomID rays[4];
+    float stepSize;         // the step the forces are applied over
+    float steerAngle;       // front wheels, chasing the steering
+    float spin[4];          // wheel roll, only for drawing
 } vehicle;
 
+// many cars stepped together, set accel and steer
+// for each car then call updateFleet
+typedef struct vehicleFleet {
+    vehicle* cars;
+    float* accel;
+    float* steer;
+    int count;
+} vehicleFleet;
+
+// surface materials, contacts between two materials
+// are looked up in a table of surface parameters
+enum { MAT_PROP, MAT_GROUND, MAT_TYRE, MAT_CHASSIS, MAT_COUNT };
+
+// collision categories, the broadphase only passes on a pair
+// when one geom's category bits are in the other's collide bits
+enum { CAT_GROUND = 1, CAT_PROP = 2, CAT_CAR = 4 };
+
 typedef struct geomInfo {
     
     bool collidable;
+    bool visible;   // drawn, only geoms that collide unless set after
+    int material;
+    
+    // render cache, filled in by createGeomInfo
+    Model* model;   // NULL if not drawn
+    Matrix scale;   // shape dimensions as a scale matrix
+    Color tint;     // tint when the body is awake
+    float radius;   // bounding sphere for culling
+    
+    // the last two stepped transforms, kept by updateGeomStates
+    // so rendering can interpolate between physics steps
+    dReal pos[3], prevPos[3];
+    dQuaternion q, prevQ;
+    bool enabled;
+    bool primed;
+    
+    int slot;               // its place in a snapshot, -1 until captured
+    unsigned int noted;     // the capture its last update was noted for
 } geomInfo ;
 
 
+// the state of a drawable geom at the time it was captured
+typedef struct geomState {
+    geomInfo* info;
+    dReal pos[3], prevPos[3];
+    dQuaternion q, prevQ;
+    bool enabled;   // false if the body is asleep
+} geomState;
+
+typedef struct geomSnapshot {
+    geomState* geoms;
+    int count;
+    int capacity;
+    unsigned int stamp;     // captures it's up to date with, 0 if none
+} geomSnapshot;
+
+// levels of detail the drawn shapes can have
+#define LOD_LEVELS 3
+
+// what got drawn since setRenderView
+typedef struct renderStats {
+    int drawn, culled;
+    int lods[LOD_LEVELS];   // drawn at each level
+} renderStats;
+
+// terrain collision sampled onto a regular grid
+typedef struct heightfield {
+    dHeightfieldDataID data;
+    dGeomID geom;
+    float* heights;
+    int samples;    // along each side
+} heightfield;
+
+// worker threads used to step the islands of a world
+typedef struct physThreading {
+    dThreadingImplementationID impl;
+    dThreadingThreadPoolID pool;
+    int count;
+} physThreading;
+
+
 void rayToOdeMat(Matrix* mat, dReal* R);
+Mesh loadObjMesh(const char* fileName);
+void freeObjMesh(Mesh mesh);
+int weldMesh(Mesh mesh, float** outVerts, int** outInd);
+heightfield* createHeightfield(dSpaceID space, const float* verts, int nV, 
+                                    const int* ind, int nI, int samples);
+void freeHeightfield(heightfield* hf);
+void composeTransforms(const Vector3* pos, const Quaternion* rot, const Vector3* scale,
+                        Matrix* out, int count);
 void odeToRayMat(const dReal* R, Matrix* matrix);
-void drawAllSpaceGeoms(dSpaceID space);
-void drawGeom(dGeomID geom);
-vehicle* CreateVehicle(dSpaceID space, dWorldID world);
+void MyDrawModel(const Model* model, const Mesh* meshes, Matrix transform, Color tint);
+void initLods(void);
+void freeLods(void);
+void setRenderView(bool cull);
+renderStats getRenderStats(void);
+void initInstancing(Shader instShader);
+void setInstancingShader(Shader instShader);
+void freeInstancing(void);
+void updateGeomStates(dSpaceID space);
+void updateBodyGeomStates(dBodyID body);
+void captureSpaceGeoms(dSpaceID space, geomSnapshot* snap);
+void freeSnapshot(geomSnapshot* snap);
+void freeSnapSlots(void);
+void drawSnapshot(const geomSnapshot* snap, float alpha);
+void drawSnapshotInstanced(const geomSnapshot* snap, float alpha);
 void updateVehicle(vehicle *car, float accel, float maxAccelForce, 
                     float steer, float steerFactor);
 void unflipVehicle (vehicle *car);
-bool checkColliding(dGeomID g);
+void setVehicleKinematic(vehicle* car, bool kinematic);
+void driveKinematicVehicle(vehicle* car, float accel, float steer, dReal groundY, float dt);
+vehicleParams defaultVehicleParams(void);
+vehicleFleet* createFleet(dSpaceID space, dSpaceID groundSpace, dWorldID world, 
+                            const vehicleParams* params, int count);
+void updateFleet(vehicleFleet* fleet, float maxAccelForce, float steerFactor);
+void freeFleet(vehicleFleet* fleet);
+geomInfo* createGeomInfo(dGeomID geom, bool collidable, int material);
+void freeSpaceGeomInfo(dSpaceID space);
+physThreading* createPhysThreading(dWorldID world, int count);
+void freePhysThreading(physThreading* pt, dWorldID world);
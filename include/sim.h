@@ -0,0 +1,183 @@
+/*
+ * Copyright (c) 2021 Chris Camacho (codifies -  http://bedroomcoders.co.uk/)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+// a self contained simulation, everything the physics needs lives
+// in a simContext so any number of them can be stepped side by side
+// include after raylibODE.h and terrain.h
+
+// what the player is doing, set by the render loop
+// and used by the physics each step
+typedef struct playerInput {
+    float accel, steer;
+    bool space;
+} playerInput;
+
+// broadphase for the space everything that moves is in
+enum { BROAD_HASH, BROAD_SAP, BROAD_QUADTREE };
+
+typedef struct simConfig {
+    int numObj;             // number of props
+    int numCars;            // the player plus computer driven traffic
+    int physThreads;        // worker threads for island stepping, 1 to step on the calling thread
+    float physSlice;        // fixed time step
+    bool groundPreprocess;  // precompute trimesh edge data and use temporal coherence
+    bool groundHeightfield; // collide with the ground as a heightfield instead of a trimesh
+    int heightfieldSamples; // per side
+    int broadphase;         // one of BROAD_*
+    int hashMinLevel, hashMaxLevel; // hash cell sizes as powers of 2
+    int quadTreeDepth;
+    int terrainTiles;       // tiles per side to stream the trimesh ground in, 0 for one trimesh
+    float terrainRadius;    // tiles this close to a car are resident
+    bool terrainWait;       // build tiles before stepping rather than in the background, keeps runs repeatable
+    bool raycastCars;       // ray wheels rather than wheel bodies on hinge2 joints
+    int contactBudget;      // contacts per step to make room for, 0 to guess
+    float lodNear, lodFar;  // traffic past lodFar from the player goes kinematic until back
+                            // inside lodNear, props past lodFar sleep sooner, 0 for off
+    bool collideTiming;     // time each narrowphase test, two clock reads a test
+    unsigned long seed;     // scene layout and prop teleports
+} simConfig;
+
+// time spent in each part of a step, added to by simGameStep and simStep
+typedef struct simTimes {
+    double game, collide, step, empty;
+} simTimes;
+
+// what the collision callback saw, tests, contacts and time are kept
+// for each pair of geom classes with the lower class first, only the
+// classes up to heightfields ever reach it, the time is only taken
+// with collideTiming set
+#define COLLIDE_CLASSES (dHeightfieldClass + 1)
+
+typedef struct collideStats {
+    unsigned long pairs;        // from the broadphase
+    unsigned long connected;    // dropped, the bodies share a joint
+    unsigned long still;        // dropped, neither body is dynamic
+    unsigned long tests[COLLIDE_CLASSES][COLLIDE_CLASSES];     // dCollide calls
+    unsigned long contacts[COLLIDE_CLASSES][COLLIDE_CLASSES];
+    double time[COLLIDE_CLASSES][COLLIDE_CLASSES];
+} collideStats;
+
+// where a body is and how it's moving, enough to put it back
+typedef struct bodyState {
+    dReal pos[3], q[4];
+    dReal vel[3], avel[3];
+    int enabled;
+} bodyState;
+
+// what a prop's body data points at, so a body can be traced
+// back to its context and where it is in the prop list
+typedef struct propRef {
+    struct simContext* sim;
+    int index;
+    bool held;              // on the held list
+} propRef;
+
+typedef struct simContext {
+    simConfig cfg;
+    dWorldID world;
+    dSpaceID space;         // everything that moves
+    dSpaceID staticSpace;   // the ground
+    dJointGroupID contactgroup;
+    physThreading* threading;
+    
+    vehicleFleet* fleet;
+    vehicle* car;           // the players car, the first in the fleet
+    int* carFlipped;        // steps each car has been on its roof
+    bodyState* carSpawn;    // 6 bodies per car as they were built
+    dBodyID* obj;
+    propRef* objRefs;
+    int* fallen;            // scratch for the props to teleport
+    bool* touching;         // props in contact during the last step
+    int* held;              // props waiting on the ground under them, in prop order
+    int heldCount;
+    dGeomID groundRay;      // finds the ground under kinematic cars
+    int kinematicCars;      // far enough away to be kinematic
+    
+    // props ODE stepped in the last step, filled in by the moved
+    // callback, asleep props aren't stepped so never appear
+    dBodyID* awake;
+    int awakeCount;
+    dBodyID* wasAwake;      // the step before
+    int wasAwakeCount;
+    
+    // the ground collision data, kept until the context is freed
+    const float* groundVerts;
+    const int* groundInd;
+    bool ownsGround;        // welded by createSim rather than passed in
+    dTriMeshDataID triData;
+    heightfield* groundHf;
+    terrain* tiles;         // instead of triData when streaming
+    Vector3* carCentres;    // where the tiles are wanted
+    
+    collideStats collide;   // for the last step
+    collideStats collideTotals;
+    
+    bool rendering;         // keep the geom render state up to date
+    unsigned long tick;     // number of physics steps so far
+    unsigned long rng;      // rand() is shared by every thread
+} simContext;
+
+// scripted input for headless runs
+typedef playerInput (*simInputFunc)(const simContext* sim, int step);
+
+// a recording of the input for every physics step, with the config
+// in its header this is enough to replay a run step for step
+typedef struct inputLog inputLog;
+
+// keeps an interactive step loop in real time when steps cost more
+// than the time they cover, the QuickStep iterations come down first
+// then the step gets longer, both recover as the cost allows
+// this changes the results so repeatable runs don't use it
+typedef struct stepScheduler {
+    float headroom;         // fraction of a step's real time it may cost
+    double cost;            // moving average of the real time per step
+    int iterations, minIterations, maxIterations;
+    float baseSlice, maxSlice;
+    int settle;             // steps until the next change is considered
+    bool degraded;          // running below the configured accuracy
+} stepScheduler;
+
+void initStepArena(size_t bytes);
+void freeStepArena(void);
+void stepArenaUsage(size_t* used, unsigned long* fallbacks);
+float carRoll(const vehicle* v);
+simContext* createSimGround(const simConfig* cfg, const float* verts, int nV,
+                                const int* ind, int nI);
+simContext* createSim(const simConfig* cfg, Mesh groundMesh);
+void freeSim(simContext* sim);
+void simGameStep(simContext* sim, const playerInput* in, simTimes* times);
+void simStep(simContext* sim, simTimes* times);
+void runSims(simContext** sims, int count, int steps, int threads,
+                simInputFunc input, simTimes* times);
+size_t simStateSize(const simContext* sim);
+void saveSimState(const simContext* sim, void* state);
+void restoreSimState(simContext* sim, const void* state);
+unsigned int simChecksum(const simContext* sim);
+inputLog* createInputLog(const char* fileName, const simConfig* cfg);
+void logInput(inputLog* log, const playerInput* in);
+int closeInputLog(inputLog* log, const simContext* sim);
+playerInput* loadInputLog(const char* fileName, simConfig* cfg, int* steps, unsigned int* checksum);
+void addCollideStats(collideStats* a, const collideStats* b);
+const char* geomClassName(int c);
+void initScheduler(stepScheduler* s, const simContext* sim, int minIterations, float maxSlice, float headroom);
+void scheduleStep(stepScheduler* s, simContext* sim, double cost);
@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2021 Chris Camacho (codifies -  http://bedroomcoders.co.uk/)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <pthread.h>
+
+// the ground cut into a grid of square tiles, collision for a tile is
+// built on a background thread when a car comes near and dropped again
+// once every car has moved away, so only the ground around the cars
+// is ever resident
+// include after raylibODE.h
+
+enum { TILE_UNLOADED, TILE_BUILDING, TILE_BUILT, TILE_RESIDENT };
+
+typedef struct terrainTile {
+    int* ind;               // its triangles, into the terrain's vertices
+    int nI;
+    float minX, minZ, maxX, maxZ;   // extent of its triangles
+    dTriMeshDataID data;    // made by the loader thread
+    dGeomID geom;           // in the space while resident, only touched by the sim
+    int state;              // one of TILE_*, guarded by the lock
+} terrainTile;
+
+typedef struct terrain {
+    const float* verts;     // shared by every tile, owned by the caller
+    int nV;
+    terrainTile* tiles;
+    int side;               // tiles per side
+    float minX, minZ, tileSize;
+    bool preprocess;        // face angles and temporal coherence
+    int resident;           // tiles in the space
+    int building;           // queued or being built
+
+    // tiles waiting for the loader thread
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake, built;
+    int* queue;
+    int queued;
+    bool quit;
+} terrain;
+
+terrain* createTerrain(const float* verts, int nV, const int* ind, int nI,
+                        int side, bool preprocess);
+void updateTerrain(terrain* t, dSpaceID space, const Vector3* centres, int count,
+                        float radius, bool wait);
+bool terrainResident(const terrain* t, float x, float z);
+void freeTerrain(terrain* t);
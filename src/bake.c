@@ -0,0 +1,269 @@
+/*
+ * Copyright (c) 2021 Chris Camacho (codifies -  http://bedroomcoders.co.uk/)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+// mmap and friends
+#define _POSIX_C_SOURCE 200809L
+
+#include "raylib.h"
+#include "raymath.h"
+
+#include <ode/ode.h>
+#include "raylibODE.h"
+#include "bake.h"
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+// the file is this header then each array at the offset given,
+// all in the byte order of the machine that baked it
+#define BAKE_MAGIC 0x454b4142  // "BAKE"
+#define BAKE_VERSION 1
+#define BAKE_ALIGN 16
+
+enum { SEC_VERTICES, SEC_NORMALS, SEC_TEXCOORDS, SEC_INDICES,
+        SEC_COL_VERTICES, SEC_COL_INDICES, SEC_COUNT };
+
+typedef struct bakeHeader {
+    uint32_t magic, version;
+    int32_t vertexCount, triangleCount;
+    int32_t colVertexCount, colIndexCount;
+    uint32_t offset[SEC_COUNT], size[SEC_COUNT];  // 0 size if not there
+} bakeHeader;
+
+static unsigned int hashFloats(const float* f, int n)
+{
+    unsigned int h = 2166136261u;
+    for (int i = 0; i < n; i++) {
+        float v = f[i] + 0.0f;  // -0 and 0 match
+        unsigned int bits;
+        memcpy(&bits, &v, sizeof(bits));
+        h = (h ^ bits) * 16777619u;
+    }
+    return h;
+}
+
+// like weldMesh but the normal and uv have to match as well, unique
+// vertices go in attribs as 8 floats each, returns how many or -1 if
+// there are more than 16 bit indices can reach
+static int weldAttribs(Mesh mesh, float* attribs, unsigned short* ind)
+{
+    int nI = mesh.triangleCount * 3;
+    int tableSize = 16;
+    while (tableSize < nI * 2) tableSize *= 2;
+    int* table = RL_MALLOC(tableSize * sizeof(int));
+    for (int i = 0; i < tableSize; i++) table[i] = -1;
+    
+    int nV = 0;
+    for (int i = 0; i < nI; i++) {
+        float v[8] = { 0 };
+        memcpy(v, &mesh.vertices[i * 3], 3 * sizeof(float));
+        if (mesh.normals) memcpy(&v[3], &mesh.normals[i * 3], 3 * sizeof(float));
+        if (mesh.texcoords) memcpy(&v[6], &mesh.texcoords[i * 2], 2 * sizeof(float));
+        
+        unsigned int slot = hashFloats(v, 8) & (tableSize - 1);
+        while (table[slot] != -1 && memcmp(&attribs[table[slot] * 8], v, sizeof(v))) {
+            slot = (slot + 1) & (tableSize - 1);
+        }
+        if (table[slot] == -1) {
+            if (nV == 65536) {
+                nV = -1;
+                break;
+            }
+            table[slot] = nV;
+            memcpy(&attribs[nV * 8], v, sizeof(v));
+            nV++;
+        }
+        ind[i] = table[slot];
+    }
+    RL_FREE(table);
+    return nV;
+}
+
+static void putSection(bakeHeader* h, int sec, uint32_t size, uint32_t* end)
+{
+    h->offset[sec] = *end;
+    h->size[sec] = size;
+    *end += (size + BAKE_ALIGN - 1) & ~(BAKE_ALIGN - 1);
+}
+
+// reads an obj file and writes it out baked, with collision the
+// welded positions and indices are baked in as well
+bool bakeObj(const char* objFile, const char* bakeFile, bool collision)
+{
+    Mesh mesh = loadObjMesh(objFile);
+    if (!mesh.vertices) return false;
+    
+    int nI = mesh.triangleCount * 3;
+    float* attribs = RL_MALLOC(nI * 8 * sizeof(float));
+    unsigned short* ind = RL_MALLOC(nI * sizeof(unsigned short));
+    int nV = weldAttribs(mesh, attribs, ind);
+    if (nV < 0) {
+        TraceLog(LOG_WARNING, "BAKE: [%s] Too many vertices for 16 bit indices", objFile);
+        RL_FREE(attribs);
+        RL_FREE(ind);
+        freeObjMesh(mesh);
+        return false;
+    }
+    
+    float* colVerts = NULL;
+    int* colInd = NULL;
+    int colV = 0;
+    if (collision) colV = weldMesh(mesh, &colVerts, &colInd);
+    
+    // split the interleaved attributes back out as raylib wants them
+    float* sections[3];
+    int widths[3] = { 3, 3, 2 };
+    for (int s = 0, first = 0; s < 3; first += widths[s], s++) {
+        sections[s] = RL_MALLOC(nV * widths[s] * sizeof(float));
+        for (int i = 0; i < nV; i++) {
+            memcpy(&sections[s][i * widths[s]], &attribs[i * 8 + first], widths[s] * sizeof(float));
+        }
+    }
+    
+    bakeHeader h = { .magic = BAKE_MAGIC, .version = BAKE_VERSION,
+                    .vertexCount = nV, .triangleCount = mesh.triangleCount,
+                    .colVertexCount = colV, .colIndexCount = collision ? nI : 0 };
+    uint32_t end = (sizeof(h) + BAKE_ALIGN - 1) & ~(BAKE_ALIGN - 1);
+    putSection(&h, SEC_VERTICES, nV * 3 * sizeof(float), &end);
+    putSection(&h, SEC_NORMALS, mesh.normals ? nV * 3 * sizeof(float) : 0, &end);
+    putSection(&h, SEC_TEXCOORDS, mesh.texcoords ? nV * 2 * sizeof(float) : 0, &end);
+    putSection(&h, SEC_INDICES, nI * sizeof(unsigned short), &end);
+    putSection(&h, SEC_COL_VERTICES, colV * 3 * sizeof(float), &end);
+    putSection(&h, SEC_COL_INDICES, h.colIndexCount * sizeof(int), &end);
+    
+    const void* data[SEC_COUNT] = { sections[0], sections[1], sections[2], ind, colVerts, colInd };
+    unsigned char* out = RL_CALLOC(end, 1);
+    memcpy(out, &h, sizeof(h));
+    for (int s = 0; s < SEC_COUNT; s++) {
+        if (h.size[s]) memcpy(out + h.offset[s], data[s], h.size[s]);
+    }
+    bool ok = SaveFileData(bakeFile, out, end);
+    
+    RL_FREE(out);
+    for (int s = 0; s < 3; s++) RL_FREE(sections[s]);
+    RL_FREE(colVerts);
+    RL_FREE(colInd);
+    RL_FREE(attribs);
+    RL_FREE(ind);
+    freeObjMesh(mesh);
+    return ok;
+}
+
+// maps a baked file, NULL if it's missing, not a bake this build can
+// read, or older than the source it was baked from (pass NULL to not
+// check), the arrays point into the mapping
+bakedMesh* loadBaked(const char* bakeFile, const char* sourceFile)
+{
+    struct stat bs, ss;
+    if (stat(bakeFile, &bs)) return NULL;
+    if (sourceFile && !stat(sourceFile, &ss) && ss.st_mtime > bs.st_mtime) {
+        TraceLog(LOG_WARNING, "BAKE: [%s] Older than %s, not used", bakeFile, sourceFile);
+        return NULL;
+    }
+    int fd = open(bakeFile, O_RDONLY);
+    if (fd < 0) return NULL;
+    void* map = mmap(NULL, bs.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return NULL;
+    
+    const bakeHeader* h = map;
+    size_t size = bs.st_size;
+    bool ok = size >= sizeof(bakeHeader) && h->magic == BAKE_MAGIC && h->version == BAKE_VERSION;
+    for (int s = 0; ok && s < SEC_COUNT; s++) {
+        ok = (size_t)h->offset[s] + h->size[s] <= size && h->offset[s] % BAKE_ALIGN == 0;
+    }
+    ok = ok && h->size[SEC_VERTICES] == h->vertexCount * 3 * sizeof(float)
+            && (!h->size[SEC_NORMALS] || h->size[SEC_NORMALS] == h->vertexCount * 3 * sizeof(float))
+            && (!h->size[SEC_TEXCOORDS] || h->size[SEC_TEXCOORDS] == h->vertexCount * 2 * sizeof(float))
+            && h->size[SEC_INDICES] == h->triangleCount * 3 * sizeof(unsigned short)
+            && h->size[SEC_COL_VERTICES] == h->colVertexCount * 3 * sizeof(float)
+            && h->size[SEC_COL_INDICES] == h->colIndexCount * sizeof(int);
+    // checked once here so nothing drawing or colliding with it has to
+    const unsigned char* base = map;
+    if (ok) {
+        const unsigned short* ind = (const unsigned short*)(base + h->offset[SEC_INDICES]);
+        for (int i = 0; ok && i < h->triangleCount * 3; i++) ok = ind[i] < h->vertexCount;
+        const int* colInd = (const int*)(base + h->offset[SEC_COL_INDICES]);
+        for (int i = 0; ok && i < h->colIndexCount; i++) {
+            ok = colInd[i] >= 0 && colInd[i] < h->colVertexCount;
+        }
+    }
+    if (!ok) {
+        TraceLog(LOG_WARNING, "BAKE: [%s] Not a usable bake, rebake it", bakeFile);
+        munmap(map, size);
+        return NULL;
+    }
+    
+    bakedMesh* b = RL_MALLOC(sizeof(bakedMesh));
+    b->map = map;
+    b->size = size;
+    b->vertexCount = h->vertexCount;
+    b->triangleCount = h->triangleCount;
+    b->vertices = (const float*)(base + h->offset[SEC_VERTICES]);
+    b->normals = h->size[SEC_NORMALS] ? (const float*)(base + h->offset[SEC_NORMALS]) : NULL;
+    b->texcoords = h->size[SEC_TEXCOORDS] ? (const float*)(base + h->offset[SEC_TEXCOORDS]) : NULL;
+    b->indices = (const unsigned short*)(base + h->offset[SEC_INDICES]);
+    b->colVertexCount = h->colVertexCount;
+    b->colIndexCount = h->colIndexCount;
+    b->colVertices = h->colVertexCount ? (const float*)(base + h->offset[SEC_COL_VERTICES]) : NULL;
+    b->colIndices = h->colIndexCount ? (const int*)(base + h->offset[SEC_COL_INDICES]) : NULL;
+    return b;
+}
+
+// raylib frees a mesh's arrays when it's unloaded so it gets its
+// own copies, upload it (or LoadModelFromMesh) as usual
+Mesh bakedRenderMesh(const bakedMesh* b)
+{
+    Mesh mesh = { 0 };
+    mesh.vertexCount = b->vertexCount;
+    mesh.triangleCount = b->triangleCount;
+    size_t vs = b->vertexCount * sizeof(float);
+    mesh.vertices = RL_MALLOC(vs * 3);
+    memcpy(mesh.vertices, b->vertices, vs * 3);
+    if (b->normals) {
+        mesh.normals = RL_MALLOC(vs * 3);
+        memcpy(mesh.normals, b->normals, vs * 3);
+    }
+    if (b->texcoords) {
+        mesh.texcoords = RL_MALLOC(vs * 2);
+        memcpy(mesh.texcoords, b->texcoords, vs * 2);
+    }
+    size_t is = b->triangleCount * 3 * sizeof(unsigned short);
+    mesh.indices = RL_MALLOC(is);
+    memcpy(mesh.indices, b->indices, is);
+    return mesh;
+}
+
+// anything using the collision arrays has to be done with them first
+void freeBaked(bakedMesh* b)
+{
+    munmap(b->map, b->size);
+    RL_FREE(b);
+}
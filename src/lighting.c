@@ -0,0 +1,143 @@
+/*
+ * Copyright (c) 2021 Chris Camacho (codifies -  http://bedroomcoders.co.uk/)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include "raylib.h"
+#include "raymath.h"
+#include "rlights.h"
+#include "lighting.h"
+
+#include <string.h>
+
+// n point and directional lights plus specular packed into one key
+static int variantKey(int points, int dirs, bool specular)
+{
+    return (points * (MAX_LIGHTS + 1) + dirs) * 2 + (specular ? 1 : 0);
+}
+
+// the defines have to come after #version so they're spliced in
+// directly after the first line of the source
+static char* injectDefines(const char* text, const char* defines)
+{
+    const char* eol = strchr(text, '\n');
+    size_t head = eol ? (size_t)(eol - text) + 1 : 0;
+    size_t dl = strlen(defines);
+    size_t tl = strlen(text);
+    char* out = RL_MALLOC(tl + dl + 1);
+    memcpy(out, text, head);
+    memcpy(out + head, defines, dl);
+    memcpy(out + head + dl, text + head, tl - head + 1);
+    return out;
+}
+
+static Shader buildVariant(lightingShader* ls, int points, int dirs, bool specular)
+{
+    const char* defines = TextFormat("#define POINT_LIGHTS %i\n#define DIR_LIGHTS %i\n#define SPECULAR %i\n",
+                            points, dirs, specular ? 1 : 0);
+    char* fs = injectDefines(ls->fsText, defines);
+    Shader s = LoadShaderFromMemory(ls->vsText, fs);
+    RL_FREE(fs);
+
+    if (ls->instanced) {
+        s.locs[SHADER_LOC_MATRIX_MODEL] = GetShaderLocationAttrib(s, "instanceTransform");
+    } else {
+        s.locs[SHADER_LOC_MATRIX_MODEL] = GetShaderLocation(s, "matModel");
+    }
+    s.locs[SHADER_LOC_VECTOR_VIEW] = GetShaderLocation(s, "viewPos");
+    SetShaderValue(s, GetShaderLocation(s, "ambient"), &ls->ambient, SHADER_UNIFORM_VEC4);
+    TraceLog(LOG_INFO, "lighting variant %i point %i directional specular %s",
+                points, dirs, specular ? "on" : "off");
+    return s;
+}
+
+lightingShader* loadLightingShader(const char* vsFile, const char* fsFile, bool instanced, Vector4 ambient)
+{
+    lightingShader* ls = RL_CALLOC(1, sizeof(lightingShader));
+    ls->vsText = LoadFileText(vsFile);
+    ls->fsText = LoadFileText(fsFile);
+    ls->instanced = instanced;
+    ls->ambient = ambient;
+    return ls;
+}
+
+// returns the variant for the enabled lights with their values
+// uploaded, only the enabled lights take a slot so the shader
+// never looks at a light that's switched off
+Shader selectLighting(lightingShader* ls, const Light* lights, int count, bool specular)
+{
+    Vector3 pointPos[MAX_LIGHTS], dirDir[MAX_LIGHTS];
+    Vector4 pointCol[MAX_LIGHTS], dirCol[MAX_LIGHTS];
+    int points = 0, dirs = 0;
+
+    for (int i = 0; i < count && i < MAX_LIGHTS; i++) {
+        if (!lights[i].enabled) continue;
+        if (lights[i].type == LIGHT_POINT) {
+            pointPos[points] = lights[i].position;
+            pointCol[points++] = ColorNormalize(lights[i].color);
+        } else {
+            dirDir[dirs] = Vector3Normalize(Vector3Subtract(lights[i].position, lights[i].target));
+            dirCol[dirs++] = ColorNormalize(lights[i].color);
+        }
+    }
+
+    int key = variantKey(points, dirs, specular);
+    Shader s = { 0 };
+    bool found = false;
+    for (int i = 0; i < ls->count; i++) {
+        if (ls->variants[i].key == key) {
+            s = ls->variants[i].shader;
+            found = true;
+            break;
+        }
+    }
+    if (!found) {
+        s = buildVariant(ls, points, dirs, specular);
+        if (ls->count < MAX_SHADER_VARIANTS) {
+            ls->variants[ls->count++] = (shaderVariant){ key, s };
+        } else {
+            // full up, there are few enough light sets this shouldn't
+            // happen but recycle the oldest rather than leak
+            UnloadShader(ls->variants[0].shader);
+            memmove(&ls->variants[0], &ls->variants[1], sizeof(shaderVariant) * (MAX_SHADER_VARIANTS - 1));
+            ls->variants[MAX_SHADER_VARIANTS - 1] = (shaderVariant){ key, s };
+        }
+    }
+
+    if (points) {
+        SetShaderValueV(s, GetShaderLocation(s, "pointPos"), pointPos, SHADER_UNIFORM_VEC3, points);
+        SetShaderValueV(s, GetShaderLocation(s, "pointColor"), pointCol, SHADER_UNIFORM_VEC4, points);
+    }
+    if (dirs) {
+        SetShaderValueV(s, GetShaderLocation(s, "dirDir"), dirDir, SHADER_UNIFORM_VEC3, dirs);
+        SetShaderValueV(s, GetShaderLocation(s, "dirColor"), dirCol, SHADER_UNIFORM_VEC4, dirs);
+    }
+    ls->current = s;
+    return s;
+}
+
+void unloadLightingShader(lightingShader* ls)
+{
+    for (int i = 0; i < ls->count; i++) UnloadShader(ls->variants[i].shader);
+    UnloadFileText(ls->vsText);
+    UnloadFileText(ls->fsText);
+    RL_FREE(ls);
+}
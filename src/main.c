@@ -21,6 +21,9 @@
  *
  */
 
+// for clock_gettime / clock_nanosleep
+#define _POSIX_C_SOURCE 200112L
+
 #include "raylib.h"
 #include "raymath.h"
 
@@ -29,8 +32,17 @@
 
 #include <ode/ode.h>
 #include "raylibODE.h"
+#include "terrain.h"
+#include "bake.h"
+#include "lighting.h"
+#include "sim.h"
+#include "profiler.h"
 
 #include "assert.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
 
 /*
  * get ODE from https://bitbucket.org/odedevs/ode/downloads/
@@ -46,94 +58,643 @@
  */
 
 
-// globals in use by near callback
-dWorldID world;
-dJointGroupID contactgroup;
+// the scene, stepped by either the main loop or the physics thread
+static simContext* sim;
+
+// the ground collision comes from the bake when there is one
+static bakedMesh* groundBake;
+static Mesh groundMesh;
 
 Model box;
 Model ball;
 Model cylinder;
 
 int numObj = 300; // number of bodies
+int numCars = 1; // the player plus computer driven traffic
+int numWorlds = 1; // independent headless worlds to benchmark side by side
+int benchJobs = 4; // threads the worlds are shared between
+int physThreads = 4; // worker threads for island stepping, 1 to step on the main thread
+bool physAsync = true; // step the physics on its own thread, decoupled from rendering
+
+// keep the physics fixed time in step with real time
+// as rendering interpolates between steps this can be
+// dropped for big scenes as long as the vehicle stays stable
+float physSlice = 1.0 / 240.0;
+bool physInterp = true; // interpolate rendering between physics steps
+bool adaptiveStep = true; // trade solver accuracy for real time under load, never when recording
+int minIterations = 8; // QuickStep iterations the scheduler can drop to
+float minHz = 120; // and the longest step it can stretch to
+float stepHeadroom = 0.6; // fraction of real time a step can cost before it degrades
+bool groundPreprocess = true; // precompute trimesh edge data and use temporal coherence
+bool groundHeightfield = false; // collide with the ground as a heightfield instead of a trimesh
+int heightfieldSamples = 64; // per side, the ground obj is a 64x64 grid
+int terrainTiles = 0; // tiles per side to stream the trimesh ground in, 0 for all of it at once
+float terrainRadius = 30; // tiles this close to a car are kept resident
+bool raycastCars = false; // suspension rays instead of wheel bodies, no wheel to ground contacts
+float lodRadius = 50; // traffic past this from the player goes kinematic and props sleep sooner, 0 for off
+bool terrainWait = false; // build tiles before stepping, always when headless or recording
+int broadphase = BROAD_HASH; // how the moving geoms are sorted for collision
+int hashMinLevel = -2, hashMaxLevel = 3; // props are 0.25 - 1, the car ~3
+int quadTreeDepth = 6;
+int stepArenaMB = 8; // per world for ODE's step memory, 0 to use ODE's allocator
+bool collideTiming = false; // time every narrowphase test, costs two clock reads each
+static const char* broadphaseNames[] = { "hash", "sap", "quadtree" };
+const char* recordFile = NULL; // log the player input each step to replay later
+const char* replayFile = NULL; // headless, step through a recorded log
+static const int maxPsteps = 6;
+
+// the last step's collision counts and the class pairs that cost most
+#define TOP_PAIRS 3
+typedef struct collideSummary {
+    unsigned long pairs, dropped, tests, contacts;
+    struct {
+        int c1, c2;
+        unsigned long tests, contacts;
+        double time;
+    } top[TOP_PAIRS];
+    int count;
+} collideSummary;
+
+// everything the renderer needs from the physics
+typedef struct frameSnapshot {
+    geomSnapshot geoms;
+    Vector3 carPos, prevCarPos;
+    Vector3 camPos;         // where the camera wants to be behind the car
+    float roll, mph;
+    int awake;              // props that moved in the last step
+    int tiles;              // terrain tiles resident
+    int kinematicCars;      // too far away for a full rig
+    collideSummary collide;
+    unsigned long tick;     // number of physics steps so far
+    unsigned long dropped;  // times the physics gave up catching up
+    double stamp;           // real time the latest step was due
+    float slice;            // length of the latest step
+    int iterations;         // QuickStep iterations it used
+    bool degraded;          // the scheduler is trading accuracy for real time
+    double physTime;
+    simTimes times;         // for the last step (or frame when not async)
+    simTimes totals;        // since the start
+} frameSnapshot;
+
+// triple buffer, the physics thread writes one snapshot while the
+// renderer reads another, the third is swapped between them
+// SNAP_FRESH is set on the shared index when it's newer than the
+// renderer's, the swaps are atomic so neither side ever blocks
+#define SNAP_FRESH 4
+static frameSnapshot snapshots[3];
+static int snapShared = 1;
+
+static playerInput sharedInput;
+static pthread_mutex_t inputLock = PTHREAD_MUTEX_INITIALIZER;
+static int physQuit = 0;
+static inputLog* recording;
+static stepScheduler scheduler;
+static bool scheduling;
+
+
+static void addTimes(simTimes* a, const simTimes* b)
+{
+    a->game += b->game;
+    a->collide += b->collide;
+    a->step += b->step;
+    a->empty += b->empty;
+}
 
+// pick the lighting variants for the lights that are switched on
+// and hand them to the models and instance buckets, the variants
+// are cached so toggling a light back and forth doesn't recompile
+static void applyLighting(lightingShader* lit, lightingShader* instLit, Model* ground,
+                            const Light* lights, int count, bool specular)
+{
+    Shader shader = selectLighting(lit, lights, count, specular);
+    box.materials[0].shader = shader;
+    ball.materials[0].shader = shader;
+    cylinder.materials[0].shader = shader;
+    ground->materials[0].shader = shader;
+    setInstancingShader(selectLighting(instLit, lights, count, specular));
+}
 
-inline float rndf(float min, float max);
-// macro candidate ? marcro's? eek!
 
-float rndf(float min, float max) 
+
+static void summariseCollide(const collideStats* s, collideSummary* sum)
 {
-    return ((float)rand() / (float)(RAND_MAX)) * (max - min) + min;
+    *sum = (collideSummary){ .pairs = s->pairs, .dropped = s->connected + s->still };
+    for (int i = 0; i < COLLIDE_CLASSES; i++) {
+        for (int j = i; j < COLLIDE_CLASSES; j++) {
+            if (!s->tests[i][j]) continue;
+            sum->tests += s->tests[i][j];
+            sum->contacts += s->contacts[i][j];
+            // insertion into the few most expensive, the most
+            // tested when the tests aren't timed
+            int at = sum->count < TOP_PAIRS ? sum->count++ : TOP_PAIRS;
+            while (at > 0 && (collideTiming ? sum->top[at - 1].time < s->time[i][j]
+                                            : sum->top[at - 1].tests < s->tests[i][j])) {
+                if (at < TOP_PAIRS) sum->top[at] = sum->top[at - 1];
+                at--;
+            }
+            if (at < TOP_PAIRS) {
+                sum->top[at].c1 = i;
+                sum->top[at].c2 = j;
+                sum->top[at].tests = s->tests[i][j];
+                sum->top[at].contacts = s->contacts[i][j];
+                sum->top[at].time = s->time[i][j];
+            }
+        }
+    }
 }
 
+// the collision counts over a run as json fields, per step
+static void printCollideJSON(const collideStats* s, int steps)
+{
+    collideSummary sum;
+    summariseCollide(s, &sum);
+    printf("\"pairsPerStep\":%.1f,\"droppedPerStep\":%.1f,\"testsPerStep\":%.1f,\"contactsPerStep\":%.1f,"
+            "\"classPairs\":[", (double)sum.pairs / steps, (double)sum.dropped / steps,
+            (double)sum.tests / steps, (double)sum.contacts / steps);
+    bool first = true;
+    for (int i = 0; i < COLLIDE_CLASSES; i++) {
+        for (int j = i; j < COLLIDE_CLASSES; j++) {
+            if (!s->tests[i][j]) continue;
+            printf("%s{\"pair\":\"%s-%s\",\"tests\":%.1f,\"contacts\":%.1f",
+                    first ? "" : ",", geomClassName(i), geomClassName(j),
+                    (double)s->tests[i][j] / steps, (double)s->contacts[i][j] / steps);
+            if (collideTiming) printf(",\"ms\":%.4f", s->time[i][j] * 1000 / steps);
+            printf("}");
+            first = false;
+        }
+    }
+    printf("]");
+}
 
+// copy out the state the renderer needs
+static void captureFrame(frameSnapshot* snap)
+{
+    vehicle* car = sim->car;
+    captureSpaceGeoms(sim->space, &snap->geoms);
+
+    // the chassis geom keeps its last two positions for interpolation
+    const geomInfo* ci = (geomInfo*)dGeomGetData(car->geoms[0]);
+    snap->carPos = (Vector3){ci->pos[0], ci->pos[1], ci->pos[2]};
+    snap->prevCarPos = (Vector3){ci->prevPos[0], ci->prevPos[1], ci->prevPos[2]};
+    dVector3 co;
+    dBodyGetRelPointPos(car->bodies[0], -8, 3, 0, co);
+    snap->camPos = (Vector3){co[0], co[1], co[2]};
+
+    snap->roll = carRoll(car);
+    const dReal* v = dBodyGetLinearVel(car->bodies[0]);
+    snap->mph = Vector3Length((Vector3){v[0],v[1],v[2]}) * 2.23693629f;
+    snap->tick = sim->tick;
+    snap->awake = sim->awakeCount;
+    snap->tiles = sim->tiles ? sim->tiles->resident : 0;
+    snap->kinematicCars = sim->kinematicCars;
+    summariseCollide(&sim->collide, &snap->collide);
+    snap->slice = sim->cfg.physSlice;
+    snap->iterations = dWorldGetQuickStepNumIterations(sim->world);
+    snap->degraded = scheduling && scheduler.degraded;
+}
 
-// when objects potentially collide this callback is called
-// you can rule out certain collisions or use different surface parameters
-// depending what object types collide.... lots of flexibility and power here!
-#define MAX_CONTACTS 8
+// runs the physics in real time independently of the render loop
+// publishing a snapshot after every step
+static void* physThread(void* arg)
+{
+    (void)arg;
+    dAllocateODEDataForThread(dAllocateMaskAll);
 
-static void nearCallback(void *data, dGeomID o1, dGeomID o2)
+    int back = 2;
+    frameSnapshot state = snapshots[0];   // running totals
+    state.geoms = (geomSnapshot){0};
+    double next = getClock();
+
+    while (!__atomic_load_n(&physQuit, __ATOMIC_ACQUIRE)) {
+        playerInput in;
+        pthread_mutex_lock(&inputLock);
+        in = sharedInput;
+        pthread_mutex_unlock(&inputLock);
+
+        double t = getClock();
+        state.times = (simTimes){0};
+        if (recording) logInput(recording, &in);
+        simGameStep(sim, &in, &state.times);
+        simStep(sim, &state.times);
+        state.physTime = getClock() - t;
+        addTimes(&state.totals, &state.times);
+        if (scheduling) scheduleStep(&scheduler, sim, state.physTime);
+
+        // geoms buffer belongs to the snapshot, the rest is copied
+        frameSnapshot* snap = &snapshots[back];
+        geomSnapshot geoms = snap->geoms;
+        state.stamp = next;
+        *snap = state;
+        snap->geoms = geoms;
+        captureFrame(snap);
+        back = __atomic_exchange_n(&snapShared, back | SNAP_FRESH, __ATOMIC_ACQ_REL) & ~SNAP_FRESH;
+
+        // wait for the next slice, if too far behind real time
+        // there's no catching up so just carry on from now
+        float slice = sim->cfg.physSlice;
+        next += slice;
+        double now = getClock();
+        if (now > next + maxPsteps * slice) {
+            next = now;
+            state.dropped++;
+        } else if (now < next) {
+            struct timespec ts;
+            ts.tv_sec = (time_t)next;
+            ts.tv_nsec = (long)((next - ts.tv_sec) * 1e9);
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+        }
+    }
+
+    dCleanupODEAllDataForThread();
+    return 0;
+}
+
+
+// the scene as set up on the command line
+static simConfig sceneConfig(unsigned long seed)
 {
-    (void)data;
-    int i;
-
-    // exit without doing anything if the two bodies are connected by a joint
-    dBodyID b1 = dGeomGetBody(o1);
-    dBodyID b2 = dGeomGetBody(o2);
-    //if (b1==b2) return;
-    if (b1 && b2 && dAreConnectedExcluding(b1, b2, dJointTypeContact))
-        return;
-        
-    if (!checkColliding(o1)) return;
-    if (!checkColliding(o2)) return;
-
-    // getting these just so can sometimes be a little bit of a black art!
-    dContact contact[MAX_CONTACTS]; // up to MAX_CONTACTS contacts per body-body
-    for (i = 0; i < MAX_CONTACTS; i++) {
-        contact[i].surface.mode = dContactSlip1 | dContactSlip2 |
-                                    dContactSoftERP | dContactSoftCFM | dContactApprox1;
-        contact[i].surface.mu = 1000;
-        contact[i].surface.slip1 = 0.0001;
-        contact[i].surface.slip2 = 0.001;
-        contact[i].surface.soft_erp = 0.05;
-        contact[i].surface.soft_cfm = 0.0003;
-      
-        contact[i].surface.bounce = 0.1;
-        contact[i].surface.bounce_vel = 0.1;
+    simConfig cfg = {
+        .numObj = numObj,
+        .numCars = numCars,
+        .physThreads = physThreads,
+        .physSlice = physSlice,
+        .groundPreprocess = groundPreprocess,
+        .groundHeightfield = groundHeightfield,
+        .heightfieldSamples = heightfieldSamples,
+        .broadphase = broadphase,
+        .hashMinLevel = hashMinLevel,
+        .hashMaxLevel = hashMaxLevel,
+        .quadTreeDepth = quadTreeDepth,
+        .terrainTiles = terrainTiles,
+        .terrainRadius = terrainRadius,
+        // back to a full rig a little closer in so it doesn't flicker
+        .lodNear = lodRadius * 0.8f,
+        .lodFar = lodRadius,
+        .raycastCars = raycastCars,
+        .terrainWait = terrainWait,
+        .collideTiming = collideTiming,
+        .seed = seed
+    };
+    return cfg;
+}
 
+static const char* groundName(void)
+{
+    if (groundHeightfield) return "heightfield";
+    return terrainTiles ? "tiles" : "trimesh";
+}
+
+// the baked ground is used in place by every world,
+// otherwise each one welds its own from the obj mesh
+static simContext* buildSim(const simConfig* cfg)
+{
+    if (groundBake && groundBake->colIndexCount) {
+        return createSimGround(cfg, groundBake->colVertices, groundBake->colVertexCount,
+                                groundBake->colIndices, groundBake->colIndexCount);
     }
-    int numc = dCollide(o1, o2, MAX_CONTACTS, &contact[0].geom,
-                        sizeof(dContact));
-    if (numc) {
-        dMatrix3 RI;
-        dRSetIdentity(RI);
-        for (i = 0; i < numc; i++) {
-            dJointID c =
-                dJointCreateContact(world, contactgroup, contact + i);
-            dJointAttach(c, b1, b2);
-        }
+    return createSim(cfg, groundMesh);
+}
+
+// a model from its bake if that's there and up to date, otherwise
+// parsed from the obj, keeps the bake if asked to
+static Model loadBakedModel(const char* objFile, const char* bakeFile, bakedMesh** keep)
+{
+    bakedMesh* baked = loadBaked(bakeFile, objFile);
+    if (keep) *keep = baked;
+    if (!baked) return LoadModel(objFile);
+    
+    Mesh mesh = bakedRenderMesh(baked);
+    UploadMesh(&mesh, false);
+    if (!keep) freeBaked(baked);
+    return LoadModelFromMesh(mesh);
+}
+
+// drives the car round in circles so the vehicle gets exercised
+static playerInput benchInput(const simContext* sim, int step)
+{
+    (void)sim;
+    playerInput in = { 40, 0.3 * sinf(step * physSlice), false };
+    return in;
+}
+
+static void closeRecording(void)
+{
+    unsigned int checksum = simChecksum(sim);
+    int steps = closeInputLog(recording, sim);
+    fprintf(stderr, "recorded %i steps to %s, checksum %08x\n", steps, recordFile, checksum);
+    recording = NULL;
+}
+
+// the inputs of a recorded run, step by step
+static playerInput* replayInputs;
+
+static playerInput replayInput(const simContext* sim, int step)
+{
+    (void)sim;
+    return replayInputs[step];
+}
+
+static int compareDouble(const void* a, const void* b)
+{
+    double d = *(const double*)a - *(const double*)b;
+    return (d > 0) - (d < 0);
+}
+
+// runs the scene as fast as it will go without a window,
+// the results are printed as a single line of json
+static void runBench(int steps, unsigned int seed, simInputFunc input)
+{
+    double* latency = RL_MALLOC(steps * sizeof(double));
+    simTimes stats = {0};
+    memset(&sim->collideTotals, 0, sizeof(collideStats));
+    
+    double start = getClock();
+    for (int i = 0; i < steps; i++) {
+        playerInput in = input(sim, i);
+        double t = getClock();
+        if (recording) logInput(recording, &in);
+        simGameStep(sim, &in, &stats);
+        simStep(sim, &stats);
+        latency[i] = getClock() - t;
+    }
+    double total = getClock() - start;
+    
+    qsort(latency, steps, sizeof(double), compareDouble);
+    size_t arenaUsed;
+    unsigned long arenaFallbacks;
+    stepArenaUsage(&arenaUsed, &arenaFallbacks);
+    printf("{\"steps\":%i,\"objects\":%i,\"cars\":%i,\"threads\":%i,\"seed\":%u,"
+            "\"ground\":\"%s\",\"wheels\":\"%s\",\"broadphase\":\"%s\",\"physHz\":%.1f,\"seconds\":%.4f,\"stepsPerSec\":%.1f,"
+            "\"gameMs\":%.4f,\"collideMs\":%.4f,\"quickStepMs\":%.4f,\"jointEmptyMs\":%.4f,"
+            "\"p50Ms\":%.4f,\"p99Ms\":%.4f,\"maxMs\":%.4f,"
+            "\"arenaKB\":%zu,\"arenaFallbacks\":%lu,",
+            steps, numObj, numCars, physThreads, seed,
+            groundName(), raycastCars ? "raycast" : "hinge2", broadphaseNames[broadphase], 1.0 / physSlice, total, steps / total,
+            stats.game * 1000 / steps, stats.collide * 1000 / steps, stats.step * 1000 / steps, 
+            stats.empty * 1000 / steps,
+            latency[steps / 2] * 1000, latency[(int)(steps * 0.99)] * 1000,
+            latency[steps - 1] * 1000, arenaUsed >> 10, arenaFallbacks);
+    printCollideJSON(&sim->collideTotals, steps);
+    printf("}\n");
+    RL_FREE(latency);
+}
+
+// as runBench but for a number of independent worlds, each with
+// its own seed, shared between a pool of threads
+static void runBatch(int steps, unsigned int seed)
+{
+    simContext** sims = RL_MALLOC(numWorlds * sizeof(simContext*));
+    simTimes* times = RL_CALLOC(numWorlds, sizeof(simTimes));
+    for (int i = 0; i < numWorlds; i++) {
+        simConfig cfg = sceneConfig(seed + i);
+        // the pool already keeps the cores busy
+        cfg.physThreads = 1;
+        sims[i] = buildSim(&cfg);
+    }
+    
+    double start = getClock();
+    runSims(sims, numWorlds, steps, benchJobs, benchInput, times);
+    double total = getClock() - start;
+    
+    simTimes sum = {0};
+    collideStats* collide = RL_CALLOC(1, sizeof(collideStats));
+    for (int i = 0; i < numWorlds; i++) {
+        addTimes(&sum, &times[i]);
+        addCollideStats(collide, &sims[i]->collideTotals);
+        freeSim(sims[i]);
     }
+    int allSteps = steps * numWorlds;
+    size_t arenaUsed;
+    unsigned long arenaFallbacks;
+    stepArenaUsage(&arenaUsed, &arenaFallbacks);
+    printf("{\"worlds\":%i,\"jobs\":%i,\"steps\":%i,\"objects\":%i,\"cars\":%i,\"seed\":%u,"
+            "\"ground\":\"%s\",\"wheels\":\"%s\",\"broadphase\":\"%s\",\"physHz\":%.1f,\"seconds\":%.4f,\"stepsPerSec\":%.1f,"
+            "\"gameMs\":%.4f,\"collideMs\":%.4f,\"quickStepMs\":%.4f,\"jointEmptyMs\":%.4f,"
+            "\"arenaKB\":%zu,\"arenaFallbacks\":%lu,",
+            numWorlds, benchJobs, steps, numObj, numCars, seed,
+            groundName(), raycastCars ? "raycast" : "hinge2", broadphaseNames[broadphase], 1.0 / physSlice, total, allSteps / total,
+            sum.game * 1000 / allSteps, sum.collide * 1000 / allSteps, sum.step * 1000 / allSteps, 
+            sum.empty * 1000 / allSteps, arenaUsed >> 10, arenaFallbacks);
+    printCollideJSON(collide, allSteps);
+    printf("}\n");
+    RL_FREE(collide);
+    RL_FREE(times);
+    RL_FREE(sims);
+}
 
+static void usage(void)
+{
+    fprintf(stderr, "options\n"
+        "  --headless       run the benchmark without a window\n"
+        "  --bake           bake the obj files in data for a quicker start\n"
+        "  --steps N        number of physics steps to benchmark (2000)\n"
+        "  --objects N      number of props (%i)\n"
+        "  --cars N         number of cars, the player and traffic (%i)\n"
+        "  --seed N         random seed, otherwise the time\n"
+        "  --threads N      island stepping threads (%i)\n"
+        "  --worlds N       headless, step N separate worlds (%i)\n"
+        "  --jobs N         threads shared by the worlds (%i)\n"
+        "  --hz N           physics steps per second (%.0f)\n"
+        "  --heightfield    collide with the ground as a heightfield\n"
+        "  --broadphase B   hash, sap or quadtree (hash)\n"
+        "  --tiles N        stream the ground in NxN tiles around the cars\n"
+        "  --tile-radius R  distance from a car tiles are resident (%.0f)\n"
+        "  --lod R          traffic and props past R from the player get less fidelity, 0 for off (%.0f)\n"
+        "  --raycast        cars with raycast wheels instead of wheel bodies\n"
+        "  --no-preprocess  don't preprocess the ground trimesh\n"
+        "  --arena N        MB per world reserved for ODE's step memory, 0 for ODE's own (%i)\n"
+        "  --collide-times  time each collision test by its pair of shapes\n"
+        "  --sync           step the physics in the render loop\n"
+        "  --fixed          never trade accuracy to keep up with real time\n"
+        "  --min-iters N    QuickStep iterations it may drop to under load (%i)\n"
+        "  --min-hz N       slowest physics rate it may stretch to under load (%.0f)\n"
+        "  --repeat N       headless, run N times resetting to the starting state, for timing\n"
+        "  --record FILE    log the input each physics step (one thread, one world), with --headless the bench input\n"
+        "  --replay FILE    headless, replay a log as fast as possible\n",
+        numObj, numCars, physThreads, numWorlds, benchJobs, 1.0 / physSlice, terrainRadius, lodRadius, stepArenaMB,
+        minIterations, minHz);
 }
 
 
-int main(void)
+int main(int argc, char** argv)
 {
     assert(sizeof(dReal) == sizeof(float));
-    srand ( time(NULL) );
+    
+    bool headless = false;
+    bool bake = false;
+    int benchSteps = 2000;
+    int benchRepeats = 1;
+    unsigned int seed = time(NULL);
+    for (int i = 1; i < argc; i++) {
+        bool more = i + 1 < argc;
+        if (!strcmp(argv[i], "--headless")) {
+            headless = true;
+        } else if (!strcmp(argv[i], "--bake")) {
+            bake = true;
+        } else if (!strcmp(argv[i], "--steps") && more) {
+            benchSteps = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--objects") && more) {
+            numObj = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--seed") && more) {
+            seed = strtoul(argv[++i], NULL, 10);
+        } else if (!strcmp(argv[i], "--cars") && more) {
+            numCars = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--threads") && more) {
+            physThreads = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--worlds") && more) {
+            numWorlds = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--jobs") && more) {
+            benchJobs = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--hz") && more) {
+            physSlice = 1.0 / atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--broadphase") && more) {
+            i++;
+            broadphase = -1;
+            for (int b = 0; b < 3; b++) {
+                if (!strcmp(argv[i], broadphaseNames[b])) broadphase = b;
+            }
+            if (broadphase < 0) {
+                usage();
+                return 1;
+            }
+        } else if (!strcmp(argv[i], "--heightfield")) {
+            groundHeightfield = true;
+        } else if (!strcmp(argv[i], "--tiles") && more) {
+            terrainTiles = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--tile-radius") && more) {
+            terrainRadius = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--raycast")) {
+            raycastCars = true;
+        } else if (!strcmp(argv[i], "--lod") && more) {
+            lodRadius = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--no-preprocess")) {
+            groundPreprocess = false;
+        } else if (!strcmp(argv[i], "--arena") && more) {
+            stepArenaMB = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--collide-times")) {
+            collideTiming = true;
+        } else if (!strcmp(argv[i], "--sync")) {
+            physAsync = false;
+        } else if (!strcmp(argv[i], "--fixed")) {
+            adaptiveStep = false;
+        } else if (!strcmp(argv[i], "--min-iters") && more) {
+            minIterations = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--min-hz") && more) {
+            minHz = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--repeat") && more) {
+            benchRepeats = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--record") && more) {
+            recordFile = argv[++i];
+        } else if (!strcmp(argv[i], "--replay") && more) {
+            replayFile = argv[++i];
+            headless = true;
+        } else {
+            usage();
+            return 1;
+        }
+    }
+    // a replay runs the scene the log was recorded with
+    unsigned int recordedChecksum = 0;
+    if (replayFile) {
+        simConfig logged = sceneConfig(seed);
+        replayInputs = loadInputLog(replayFile, &logged, &benchSteps, &recordedChecksum);
+        if (!replayInputs) return 1;
+        seed = logged.seed;
+        numObj = logged.numObj;
+        numCars = logged.numCars;
+        physThreads = logged.physThreads;
+        physSlice = logged.physSlice;
+        groundPreprocess = logged.groundPreprocess;
+        groundHeightfield = logged.groundHeightfield;
+        heightfieldSamples = logged.heightfieldSamples;
+        broadphase = logged.broadphase;
+        hashMinLevel = logged.hashMinLevel;
+        hashMaxLevel = logged.hashMaxLevel;
+        quadTreeDepth = logged.quadTreeDepth;
+        terrainTiles = logged.terrainTiles;
+        terrainRadius = logged.terrainRadius;
+        lodRadius = logged.lodFar;
+        raycastCars = logged.raycastCars;
+        numWorlds = 1;
+    }
+    if (benchRepeats < 1 || benchSteps < 1 || numObj < 1 || numCars < 1 || numWorlds < 1 || benchJobs < 1 || stepArenaMB < 0 || physSlice <= 0
+            || terrainTiles < 0 || terrainRadius <= 0 || lodRadius < 0 || minIterations < 1 || minHz <= 0
+            || (recordFile && numWorlds > 1)) {
+        usage();
+        return 1;
+    }
+    // the ground keeps its collision in the bake, the cylinder only renders
+    if (bake) {
+        SetTraceLogLevel(LOG_WARNING);
+        bool ok = bakeObj("data/ground.obj", "data/ground.bake", true)
+                    && bakeObj("data/cylinder.obj", "data/cylinder.bake", false);
+        return ok ? 0 : 1;
+    }
+    
+    // the scene has its own random numbers, ODE's are used inside the step
+    dRandSetSeed( seed );
+    
+    dInitODE2(0);   // initialise and create the physics
+    dAllocateODEDataForThread(dAllocateMaskAll);
+    if (stepArenaMB) initStepArena((size_t)stepArenaMB * numWorlds << 20);
+    // streaming in the background makes what's resident depend on timing
+    if (headless || recordFile) terrainWait = true;
+    // so does which worker gets which island, a recording steps on one thread
+    if (recordFile) physThreads = 1;
+    simConfig cfg = sceneConfig(seed);
+    
+    if (headless) {
+        // raylib is only used for its maths and file loading here
+        SetTraceLogLevel(LOG_WARNING);
+        groundBake = loadBaked("data/ground.bake", "data/ground.obj");
+        if (!groundBake || !groundBake->colIndexCount) {
+            groundMesh = loadObjMesh("data/ground.obj");
+            if (!groundMesh.vertices) return 1;
+        }
+        int status = 0;
+        if (numWorlds > 1) {
+            runBatch(benchSteps, seed);
+        } else {
+            sim = buildSim(&cfg);
+            if (recordFile) recording = createInputLog(recordFile, &cfg);
+            
+            // repeats start again from the state as it was built
+            // rather than building the world all over again, the bodies
+            // go back but not the order ODE keeps the geoms in (or the
+            // tiles still resident) so only the first run is exact
+            void* start = RL_MALLOC(simStateSize(sim));
+            saveSimState(sim, start);
+            for (int r = 0; r < benchRepeats; r++) {
+                if (r) {
+                    double t = getClock();
+                    restoreSimState(sim, start);
+                    fprintf(stderr, "reset in %.3fms\n", (getClock() - t) * 1000);
+                }
+                runBench(benchSteps, seed, replayFile ? replayInput : benchInput);
+                if (recording) closeRecording();
+                if (replayFile) {
+                    unsigned int checksum = simChecksum(sim);
+                    printf("{\"replay\":\"%s\",\"run\":%i,\"checksum\":\"%08x\",\"recorded\":\"%08x\",\"matches\":%s}\n",
+                            replayFile, r, checksum, recordedChecksum, checksum == recordedChecksum ? "true" : "false");
+                    if (!r && checksum != recordedChecksum) status = 1;
+                }
+            }
+            RL_FREE(start);
+            RL_FREE(replayInputs);
+            freeSim(sim);
+        }
+        if (groundBake) freeBaked(groundBake);
+        freeObjMesh(groundMesh);
+        if (stepArenaMB) freeStepArena();
+        dCloseODE();
+        return status;
+    }
 
     // Initialization
     //--------------------------------------------------------------------------------------
     const int screenWidth = 1920/2;
     const int screenHeight = 1080/2;
 
-    // a space can have multiple "worlds" for example you might have different
-    // sub levels that never interact, or the inside and outside of a building
-    dSpaceID space;
-
-    // create an array of bodies
-    dBodyID obj[numObj];
-
     SetWindowState(FLAG_VSYNC_HINT | FLAG_MSAA_4X_HINT);
     InitWindow(screenWidth, screenHeight, "raylib ODE and a car!");
 
@@ -145,9 +706,10 @@ int main(void)
     ball = LoadModelFromMesh(GenMeshSphere(.5,32,32));
     // alas gen cylinder is wrong orientation for ODE...
     // so rather than muck about at render time just make one the right orientation
-    cylinder = LoadModel("data/cylinder.obj");
+    cylinder = loadBakedModel("data/cylinder.obj", "data/cylinder.bake", NULL);
     
-    Model ground = LoadModel("data/ground.obj");
+    Model ground = loadBakedModel("data/ground.obj", "data/ground.bake", &groundBake);
+    groundMesh = ground.meshes[0];
 
     // texture the models
     Texture earthTx = LoadTexture("data/earth.png");
@@ -160,141 +722,58 @@ int main(void)
     cylinder.materials[0].maps[MATERIAL_MAP_DIFFUSE].texture = drumTx;
     ground.materials[0].maps[MATERIAL_MAP_DIFFUSE].texture = grassTx;
 
-    Shader shader = LoadShader("data/simpleLight.vs", "data/simpleLight.fs");
-    // load a shader and set up some uniforms
-    shader.locs[SHADER_LOC_MATRIX_MODEL] = GetShaderLocation(shader, "matModel");
-    shader.locs[SHADER_LOC_VECTOR_VIEW] = GetShaderLocation(shader, "viewPos");
-
-    
-    // ambient light level
-    int amb = GetShaderLocation(shader, "ambient");
-    SetShaderValue(shader, amb, (float[4]){0.2,0.2,0.2,1.0}, SHADER_UNIFORM_VEC4);
-
-    // models share the same shader
-    box.materials[0].shader = shader;
-    ball.materials[0].shader = shader;
-    cylinder.materials[0].shader = shader;
-    ground.materials[0].shader = shader;
-    
-    // using 4 point lights, white, red, green and blue
-    Light lights[MAX_LIGHTS];
-
-    lights[0] = CreateLight(LIGHT_POINT, (Vector3){ -25,25,25 }, Vector3Zero(),
-                    (Color){128,128,128,255}, shader);
-    lights[1] = CreateLight(LIGHT_POINT, (Vector3){ -25,25,-25 }, Vector3Zero(),
-                    (Color){64,64,64,255}, shader);
-/*                    
-    lights[2] = CreateLight(LIGHT_POINT, (Vector3){ -25,25,-25 }, Vector3Zero(),
-                    GREEN, shader);
-    lights[3] = CreateLight(LIGHT_POINT, (Vector3){ -25,25,25 }, Vector3Zero(),
-                    BLUE, shader);
-*/
-
-    dInitODE2(0);   // initialise and create the physics
-    dAllocateODEDataForThread(dAllocateMaskAll);
-    
-    world = dWorldCreate();
-    printf("phys iterations per step %i\n",dWorldGetQuickStepNumIterations(world));
-    space = dHashSpaceCreate(NULL);
-    contactgroup = dJointGroupCreate(0);
-    dWorldSetGravity(world, 0, -9.8, 0);    // gravity
-    
-    dWorldSetAutoDisableFlag (world, 1);
-    dWorldSetAutoDisableLinearThreshold (world, 0.05);
-    dWorldSetAutoDisableAngularThreshold (world, 0.05);
-    dWorldSetAutoDisableSteps (world, 4);
-
-
-    vehicle* car = CreateVehicle(space, world);
-    
-    // create some decidedly sub optimal indices!
-    // for the ground trimesh
-    int nV = ground.meshes[0].vertexCount;
-    int *groundInd = RL_MALLOC(nV*sizeof(int));
-    for (int i = 0; i<nV; i++ ) {
-        groundInd[i] = i;
-    }
-    
-    // static tri mesh data to geom
-    dTriMeshDataID triData = dGeomTriMeshDataCreate();
-    dGeomTriMeshDataBuildSingle(triData, ground.meshes[0].vertices,
-                            3 * sizeof(float), nV,
-                            groundInd, nV,
-                            3 * sizeof(int));
-    dCreateTriMesh(space, triData, NULL, NULL, NULL);
-    
-
-    // create the physics bodies
-    for (int i = 0; i < numObj; i++) {
-        obj[i] = dBodyCreate(world);
-        dGeomID geom;
-        dMatrix3 R;
-        dMass m;
-        float typ = rndf(0,1);
-        if (typ < .25) {                //  box
-            Vector3 s = (Vector3){rndf(0.25, .5), rndf(0.25, .5), rndf(0.25, .5)};
-            geom = dCreateBox(space, s.x, s.y, s.z);
-            dMassSetBox (&m, 10, s.x, s.y, s.z);
-        } else if (typ < .5) {          //  sphere
-            float r = rndf(0.125, .25);
-            geom = dCreateSphere(space, r);
-            dMassSetSphere(&m, 10, r);
-        } else if (typ < .75) {         //  cylinder
-            float l = rndf(0.125, .5);
-            float r = rndf(0.125, .5);
-            geom = dCreateCylinder(space, r, l);
-            dMassSetCylinder(&m, 10, 3, r, l);
-        } else {                        //  composite of cylinder with 2 spheres
-            float l = rndf(.25,.5);
-            
-            geom = dCreateCylinder(space, 0.125, l);
-            dGeomID geom2 = dCreateSphere(space, l/2);
-            dGeomID geom3 = dCreateSphere(space, l/2);
-
-            
-            dMass m2,m3;
-            dMassSetSphere(&m2, 5, l/2);
-            dMassTranslate(&m2,0, 0, l - 0.125);
-            dMassSetSphere(&m3, 5, l/2);
-            dMassTranslate(&m3,0, 0, -l + 0.125);
-            dMassSetCylinder(&m, 5, 3, .25, l);
-            dMassAdd(&m2, &m3);
-            dMassAdd(&m, &m2);
-            
-            dGeomSetBody(geom2, obj[i]);
-            dGeomSetBody(geom3, obj[i]);
-            dGeomSetOffsetPosition(geom2, 0, 0, l - 0.125);
-            dGeomSetOffsetPosition(geom3, 0, 0, -l + 0.125);
-
-        }
-
-        // give the body a random position and rotation
-        dBodySetPosition(obj[i],
-                            dRandReal() * 80 - 40, 4+(i/10), dRandReal() * 80 - 40);
-        dRFromAxisAndAngle(R, dRandReal() * 2.0 - 1.0,
-                            dRandReal() * 2.0 - 1.0,
-                            dRandReal() * 2.0 - 1.0,
-                            dRandReal() * M_PI*2 - M_PI);
-        dBodySetRotation(obj[i], R);
-        // set the bodies mass and the newly created geometry
-        dGeomSetBody(geom, obj[i]);
-        dBodySetMass(obj[i], &m);
-
-
-    }
+    // the lighting shaders are compiled for the set of lights in use
+    // rather than looping over every light and skipping the ones off
+    Vector4 ambient = { 0.2, 0.2, 0.2, 1.0 };
+    lightingShader* lit = loadLightingShader("data/simpleLight.vs", "data/simpleLight.fs", false, ambient);
+    // same lighting but the model matrix comes from a per instance
+    // attribute so all the bodies of one type are a single draw call
+    lightingShader* instLit = loadLightingShader("data/simpleLightInstanced.vs", "data/simpleLight.fs", true, ambient);
+    initLods();
+    // applyLighting below gives the buckets their shader
+    initInstancing((Shader){ 0 });
     
+    // two grey point lights, the uniforms are set by selectLighting
+    // so these don't need a shader of their own like CreateLight
+    Light lights[MAX_LIGHTS] = { 0 };
+    int numLights = 2;
+    lights[0] = (Light){ .type = LIGHT_POINT, .enabled = true, .position = { -25,25,25 },
+                    .color = {128,128,128,255} };
+    lights[1] = (Light){ .type = LIGHT_POINT, .enabled = true, .position = { -25,25,-25 },
+                    .color = {64,64,64,255} };
+    bool specular = true;
+    applyLighting(lit, instLit, &ground, lights, numLights, specular);
+
+    sim = buildSim(&cfg);
+    sim->rendering = true;
+    fprintf(stderr, "phys iterations per step %i\n",dWorldGetQuickStepNumIterations(sim->world));
+    // a recording has to step exactly as it will be replayed
+    scheduling = adaptiveStep && !recordFile;
+    if (scheduling) initScheduler(&scheduler, sim, minIterations, 1.0 / minHz, stepHeadroom);
 
     float accel=0,steer=0;
     Vector3 debug = {0};
     bool antiSway = true;
+    bool instanced = true;
+    bool culling = true;
     
     // keep the physics fixed time in step with the render frame
     // rate which we don't know in advance
     float frameTime = 0; 
-    float physTime = 0;
-    const float physSlice = 1.0 / 240.0;
-    const int maxPsteps = 6;
-    int carFlipped = 0; // number of frames car roll is >90
+    
+    // the renderer only ever looks at the front snapshot
+    int front = 0;
+    updateGeomStates(sim->space);
+    captureFrame(&snapshots[front]);
+    if (recordFile) recording = createInputLog(recordFile, &cfg);
+    unsigned long lastTick = 0, lastDropped = 0;
+    simTimes lastTotals = {0};
+    bool profiling = false;
+
+    pthread_t physThreadID = 0;
+    if (physAsync) {
+        pthread_create(&physThreadID, NULL, physThread, NULL);
+    }
 
     //--------------------------------------------------------------------------------------
     //
@@ -306,28 +785,8 @@ int main(void)
         //--------------------------------------------------------------------------------------
         // Update
         //----------------------------------------------------------------------------------
+        profNextFrame();
 
-
-        
-        // extract just the roll of the car
-        // count how many frames its >90 degrees either way
-        const dReal* q = dBodyGetQuaternion(car->bodies[0]);
-        float z0 = 2.0f*(q[0]*q[3] + q[1]*q[2]);
-        float z1 = 1.0f - 2.0f*(q[1]*q[1] + q[3]*q[3]);
-        float roll = atan2f(z0, z1);
-        if ( fabs(roll) > (M_PI_2-0.001) ) {
-            carFlipped++;
-        } else {
-            carFlipped=0;
-        }
-    
-        // if the car roll >90 degrees for 100 frames then flip it
-        if (carFlipped > 100) {
-            unflipVehicle(car);
-        }
-
-
-        
         accel *= .99;
         if (IsKeyDown(KEY_UP)) accel +=2.5;
         if (IsKeyDown(KEY_DOWN)) accel -=2.5;
@@ -341,96 +800,112 @@ int main(void)
         if (steer > .5) steer = .5;
         if (steer < -.5) steer = -.5;
 
-              
-        updateVehicle(car, accel, 800.0, steer, 10.0);
-
-
-        const dReal* cp = dBodyGetPosition(car->bodies[0]);
-        camera.target = (Vector3){cp[0],cp[1]+1,cp[2]};
-        
-        float lerp = 0.1f;
-
-        dVector3 co;
-        dBodyGetRelPointPos(car->bodies[0], -8, 3, 0, co);
-        
-        camera.position.x -= (camera.position.x - co[0]) * lerp  ;// * (1/ft);
-        camera.position.y -= (camera.position.y - co[1])  * lerp ;// * (1/ft);
-        camera.position.z -= (camera.position.z - co[2]) * lerp ;// * (1/ft);
-        //UpdateCamera(&camera);
+        playerInput input = { accel, steer, IsKeyDown(KEY_SPACE) };
         
-        bool spcdn = IsKeyDown(KEY_SPACE);
-        
-        for (int i = 0; i < numObj; i++) {
-            const dReal* pos = dBodyGetPosition(obj[i]);
-            if (spcdn) {
-                // apply force if the space key is held
-                const dReal* v = dBodyGetLinearVel(obj[0]);
-                if (v[1] < 10 && pos[1]<10) { // cap upwards velocity and don't let it get too high
-                    dBodyEnable (obj[i]); // case its gone to sleep
-                    dMass mass;
-                    dBodyGetMass (obj[i], &mass);
-                    // give some object more force than others
-                    float f = (6+(((float)i/numObj)*4)) * mass.mass;
-                    dBodyAddForce(obj[i], rndf(-f,f), f*10, rndf(-f,f));
-                }
+        if (physAsync) {
+            pthread_mutex_lock(&inputLock);
+            sharedInput = input;
+            pthread_mutex_unlock(&inputLock);
+            
+            // pick up the latest complete snapshot if there is one
+            if (__atomic_load_n(&snapShared, __ATOMIC_ACQUIRE) & SNAP_FRESH) {
+                front = __atomic_exchange_n(&snapShared, front, __ATOMIC_ACQ_REL) & ~SNAP_FRESH;
             }
-
+        } else {
+            frameSnapshot* snap = &snapshots[front];
+            frameTime += GetFrameTime();
+            double physTime = getClock(); 
+            snap->times = (simTimes){0};
             
-            if(pos[1]<-10) {
-                // teleport back if fallen off the ground
-                dBodySetPosition(obj[i], dRandReal() * 80 - 40,
-                                        12 + rndf(1,2), dRandReal() * 80 - 40);
-                dBodySetLinearVel(obj[i], 0, 0, 0);
-                dBodySetAngularVel(obj[i], 0, 0, 0);
+            int pSteps = 0;
+            while (frameTime > sim->cfg.physSlice) {
+                double stepTime = getClock();
+                if (recording) logInput(recording, &input);
+                simGameStep(sim, &input, &snap->times);
+                simStep(sim, &snap->times);
+                
+                frameTime -= sim->cfg.physSlice;
+                if (scheduling) scheduleStep(&scheduler, sim, getClock() - stepTime);
+                pSteps++;
+                if (pSteps > maxPsteps) {
+                    frameTime = 0;
+                    snap->dropped++;
+                    break;      
+                }
             }
+            
+            snap->physTime = getClock() - physTime;
+            addTimes(&snap->totals, &snap->times);
+            captureFrame(snap);
         }
         
-        const dReal* pos = dBodyGetPosition(car->bodies[0]);
-        if (pos[1]<-10) {
-            for (int i=0; i<6; i++) {
-                dBodySetPosition(car->bodies[i], 0, 6, 0);
-                dBodySetLinearVel(car->bodies[i], 0, 0, 0);
-                dBodySetAngularVel(car->bodies[i], 0, 0, 0);
-                
+        const frameSnapshot* view = &snapshots[front];
+        
+        // the physics stepped since the last frame is in the difference
+        // between the totals, whichever thread ran it
+        profAdd(PROF_GAME, view->totals.game - lastTotals.game);
+        profAdd(PROF_COLLIDE, view->totals.collide - lastTotals.collide);
+        profAdd(PROF_QUICKSTEP, view->totals.step - lastTotals.step);
+        profAdd(PROF_JOINTEMPTY, view->totals.empty - lastTotals.empty);
+        lastTotals = view->totals;
+        
+        // how far between the last two physics steps to draw things
+        float alpha = 1;
+        if (physInterp) {
+            if (physAsync) {
+                alpha = (getClock() - view->stamp) / view->slice;
+            } else {
+                alpha = frameTime / view->slice;
             }
+            alpha = Clamp(alpha, 0, 1);
         }
+        int pSteps = view->tick - lastTick;
+        bool lagging = view->dropped != lastDropped;
+        lastTick = view->tick;
+        lastDropped = view->dropped;
+
+        Vector3 cp = Vector3Lerp(view->prevCarPos, view->carPos, alpha);
+        camera.target = (Vector3){cp.x, cp.y+1, cp.z};
         
-        //UpdateCamera(&camera);              // Update camera
+        float lerp = 0.1f;
 
-        if (IsKeyPressed(KEY_L)) { lights[0].enabled = !lights[0].enabled; UpdateLightValues(shader, lights[0]);}
+        Vector3 co = view->camPos;
         
-        // update the light shader with the camera view position
-        SetShaderValue(shader, shader.locs[SHADER_LOC_VECTOR_VIEW], &camera.position.x, SHADER_UNIFORM_VEC3);
+        camera.position.x -= (camera.position.x - co.x) * lerp  ;// * (1/ft);
+        camera.position.y -= (camera.position.y - co.y)  * lerp ;// * (1/ft);
+        camera.position.z -= (camera.position.z - co.z) * lerp ;// * (1/ft);
+        //UpdateCamera(&camera);
+        
+        //UpdateCamera(&camera);              // Update camera
 
-        frameTime += GetFrameTime();
-        int pSteps = 0;
-        physTime = GetTime(); 
+        if (IsKeyPressed(KEY_L)) { 
+            lights[0].enabled = !lights[0].enabled; 
+            applyLighting(lit, instLit, &ground, lights, numLights, specular);
+        }
+        if (IsKeyPressed(KEY_K)) {
+            specular = !specular;
+            applyLighting(lit, instLit, &ground, lights, numLights, specular);
+        }
         
-        while (frameTime > physSlice) {
-            // check for collisions
-            // TODO use 2nd param data to pass custom structure with
-            // world and space ID's to avoid use of globals...
-            dSpaceCollide(space, 0, &nearCallback);
-            
-            // step the world
-            dWorldQuickStep(world, physSlice);  // NB fixed time step is important
-            dJointGroupEmpty(contactgroup);
-            
-            frameTime -= physSlice;
-            pSteps++;
-            if (pSteps > maxPsteps) {
-                frameTime = 0;
-                break;      
+        if (IsKeyPressed(KEY_I)) instanced = !instanced;
+        if (IsKeyPressed(KEY_C)) culling = !culling;
+        if (IsKeyPressed(KEY_P)) profiling = !profiling;
+        if (IsKeyPressed(KEY_F2)) {
+            if (saveProfileCSV("profile.csv") && saveProfileTrace("profile.json")) {
+                TraceLog(LOG_INFO, "saved profile.csv and profile.json");
             }
         }
         
-        physTime = GetTime() - physTime;    
-
-        
+        // update the light shader with the camera view position
+        SetShaderValue(lit->current, lit->current.locs[SHADER_LOC_VECTOR_VIEW], &camera.position.x, SHADER_UNIFORM_VEC3);
+        SetShaderValue(instLit->current, instLit->current.locs[SHADER_LOC_VECTOR_VIEW], &camera.position.x, SHADER_UNIFORM_VEC3);
 
         //----------------------------------------------------------------------------------
         // Draw
         //----------------------------------------------------------------------------------
+        // instancing adds its own transform time, the rest is drawing
+        double drawStart = getClock();
+        double transforms = profStage(PROF_TRANSFORMS);
      
         BeginDrawing();
 
@@ -444,32 +919,69 @@ int main(void)
             // from the body you'd previously set and use that to look up
             // what you are rendering oriented and positioned as per the
             // body
-            drawAllSpaceGeoms(space);        
+            setRenderView(culling);
+            if (instanced) {
+                drawSnapshotInstanced(&view->geoms, alpha);
+            } else {
+                drawSnapshot(&view->geoms, alpha);
+            }
             DrawGrid(100, 1.0f);
 
         EndMode3D();
 
         //DrawFPS(10, 10); // can't see it in lime green half the time!!
 
-        if (pSteps > maxPsteps) DrawText("WARNING CPU overloaded lagging real time", 10, 0, 20, RED);
+        if (lagging) DrawText("WARNING CPU overloaded lagging real time", 10, 0, 20, RED);
         DrawText(TextFormat("%2i FPS", GetFPS()), 10, 20, 20, WHITE);
         DrawText(TextFormat("accel %4.4f",accel), 10, 40, 20, WHITE);
         DrawText(TextFormat("steer %4.4f",steer), 10, 60, 20, WHITE);
         if (!antiSway) DrawText("Anti sway bars OFF", 10, 80, 20, RED);
         DrawText(TextFormat("debug %4.4f %4.4f %4.4f",debug.x,debug.y,debug.z), 10, 100, 20, WHITE);
         DrawText(TextFormat("Phys steps per frame %i",pSteps), 10, 120, 20, WHITE);
-        DrawText(TextFormat("Phys time per frame %f",physTime), 10, 140, 20, WHITE);
-        DrawText(TextFormat("total time per frame %f",frameTime), 10, 160, 20, WHITE);
-        DrawText(TextFormat("objects %i",numObj), 10, 180, 20, WHITE);
+        DrawText(TextFormat("Phys time per %s %f (collide %f step %f on %i threads)",
+                    physAsync ? "step" : "frame", view->physTime, view->times.collide, view->times.step, 
+                    sim->threading ? sim->threading->count : 1), 10, 140, 20, WHITE);
+        // the accumulator only runs when stepping in the render loop,
+        // on its own thread what's drawn is as old as the snapshot
+        DrawText(TextFormat("total time per frame %f, %s %f", GetFrameTime(),
+                    physAsync ? "snapshot age" : "left to step", 
+                    physAsync ? getClock() - view->stamp : frameTime), 10, 160, 20, WHITE);
+        DrawText(TextFormat("objects %i (%i awake) cars %i, %s broadphase",numObj,view->awake,numCars,
+                    broadphaseNames[broadphase]), 10, 180, 20, WHITE);
 
     
-        DrawText(TextFormat("roll %.4f",fabs(roll)), 10, 200, 20, WHITE);
+        DrawText(TextFormat("roll %.4f",fabs(view->roll)), 10, 200, 20, WHITE);
         
-        const float* v = dBodyGetLinearVel(car->bodies[0]);
-        float vel = Vector3Length((Vector3){v[0],v[1],v[2]}) * 2.23693629f;
-        DrawText(TextFormat("mph %.4f",vel), 10, 220, 20, WHITE);
+        DrawText(TextFormat("mph %.4f",view->mph), 10, 220, 20, WHITE);
+        DrawText(TextFormat("instanced rendering %s (I)", instanced ? "ON" : "OFF"), 10, 240, 20, WHITE);
+        if (physAsync) DrawText("physics on its own thread", 10, 260, 20, WHITE);
+        renderStats rs = getRenderStats();
+        DrawText(TextFormat("drawn %i culled %i lods %i/%i/%i, culling %s (C)", rs.drawn, rs.culled,
+                    rs.lods[0], rs.lods[1], rs.lods[2], culling ? "ON" : "OFF"), 10, 280, 20, WHITE);
+        DrawText(TextFormat("profiler %s (P) F2 to save", profiling ? "ON" : "OFF"), 10, 300, 20, WHITE);
+        if (terrainTiles) DrawText(TextFormat("terrain tiles %i of %i resident", view->tiles,
+                                    terrainTiles * terrainTiles), 10, 320, 20, WHITE);
+        if (lodRadius > 0) DrawText(TextFormat("%i cars kinematic past %.0f", view->kinematicCars, lodRadius),
+                                    10, 380, 20, WHITE);
+        const collideSummary* cs = &view->collide;
+        DrawText(TextFormat("collide pairs %lu (%lu dropped) tests %lu contacts %lu", cs->pairs, cs->dropped,
+                    cs->tests, cs->contacts), 10, 400, 20, WHITE);
+        for (int i = 0; i < cs->count; i++) {
+            DrawText(TextFormat("  %s-%s %lu tests %lu contacts%s", geomClassName(cs->top[i].c1),
+                        geomClassName(cs->top[i].c2), cs->top[i].tests, cs->top[i].contacts,
+                        collideTiming ? TextFormat(" %.3fms", cs->top[i].time * 1000) : ""),
+                        10, 420 + i * 20, 20, WHITE);
+        }
+        DrawText(TextFormat("lighting variant %i lights, specular %s (L K) %i compiled",
+                    lights[0].enabled + lights[1].enabled, specular ? "ON" : "OFF", lit->count), 10, 340, 20, WHITE);
+        DrawText(TextFormat("solver %i iterations at %.0f Hz%s", view->iterations, 1.0 / view->slice,
+                    view->degraded ? ", trading accuracy for real time" : ""), 10, 360, 20,
+                    view->degraded ? ORANGE : WHITE);
+        if (profiling) drawProfiler(screenWidth - 250, 10, 240, 120);
 //printf("%i %i\n",pSteps, numObj);
 
+        // not including the swap, waiting for vsync isn't drawing
+        profAdd(PROF_DRAW, getClock() - drawStart - (profStage(PROF_TRANSFORMS) - transforms));
         EndDrawing();
 
     }
@@ -479,6 +991,14 @@ int main(void)
     //--------------------------------------------------------------------------------------
     // De-Initialization
     //--------------------------------------------------------------------------------------
+    if (physAsync) {
+        __atomic_store_n(&physQuit, 1, __ATOMIC_RELEASE);
+        pthread_join(physThreadID, NULL);
+    }
+    for (int i = 0; i < 3; i++) freeSnapshot(&snapshots[i].geoms);
+    freeSnapSlots();
+    if (recording) closeRecording();
+    
     UnloadModel(box);
     UnloadModel(ball);
     UnloadModel(cylinder);
@@ -487,17 +1007,14 @@ int main(void)
     UnloadTexture(earthTx);
     UnloadTexture(crateTx);
     UnloadTexture(grassTx);
-    UnloadShader(shader);
+    freeInstancing();
+    freeLods();
+    unloadLightingShader(instLit);
+    unloadLightingShader(lit);
     
-    RL_FREE(car);
-    
-    RL_FREE(groundInd);
-    dGeomTriMeshDataDestroy(triData);
-
-    dJointGroupEmpty(contactgroup);
-    dJointGroupDestroy(contactgroup);
-    dSpaceDestroy(space);
-    dWorldDestroy(world);
+    freeSim(sim);
+    if (groundBake) freeBaked(groundBake);
+    if (stepArenaMB) freeStepArena();
     dCloseODE();
 
     CloseWindow();              // Close window and OpenGL context
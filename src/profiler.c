@@ -0,0 +1,200 @@
+/*
+ * Copyright (c) 2021 Chris Camacho (codifies -  http://bedroomcoders.co.uk/)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+// for clock_gettime
+#define _POSIX_C_SOURCE 200112L
+
+#include "raylib.h"
+
+#include "profiler.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+
+static const char* stageNames[PROF_STAGES] = {
+    "game", "collide", "quickstep", "joint empty", "transforms", "draw"
+};
+static const Color stageColors[PROF_STAGES] = {
+    { 255, 161, 0, 255 }, { 230, 41, 55, 255 }, { 0, 228, 48, 255 },
+    { 253, 249, 0, 255 }, { 0, 121, 241, 255 }, { 200, 122, 255, 255 }
+};
+
+// ring of frames, cur is the one being filled in
+static profFrame frames[PROF_FRAMES];
+static int cur = 0;
+static int complete = 0;    // finished frames in the ring
+
+
+double getClock(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// call once at the start of each frame, finishes the last one
+void profNextFrame(void)
+{
+    double now = getClock();
+    if (frames[cur].start > 0) {
+        frames[cur].total = now - frames[cur].start;
+        cur = (cur + 1) % PROF_FRAMES;
+        if (complete < PROF_FRAMES - 1) complete++;
+    }
+    memset(&frames[cur], 0, sizeof(profFrame));
+    frames[cur].start = now;
+}
+
+void profAdd(int stage, double seconds)
+{
+    frames[cur].stage[stage] += seconds;
+}
+
+// what's been added to a stage so far this frame
+double profStage(int stage)
+{
+    return frames[cur].stage[stage];
+}
+
+// the finished frames oldest first
+static const profFrame* finishedFrame(int i)
+{
+    return &frames[(cur - complete + i + PROF_FRAMES) % PROF_FRAMES];
+}
+
+static int compareFloat(const void* a, const void* b)
+{
+    float d = *(const float*)a - *(const float*)b;
+    return (d > 0) - (d < 0);
+}
+
+// in milliseconds over the kept frames, stage PROF_STAGES
+// gives the whole frame time
+void profPercentiles(int stage, float* p50, float* p95, float* p99)
+{
+    *p50 = *p95 = *p99 = 0;
+    if (!complete) return;
+    
+    float ms[PROF_FRAMES];
+    for (int i = 0; i < complete; i++) {
+        const profFrame* f = finishedFrame(i);
+        ms[i] = (stage == PROF_STAGES ? f->total : f->stage[stage]) * 1000;
+    }
+    qsort(ms, complete, sizeof(float), compareFloat);
+    *p50 = ms[complete / 2];
+    *p95 = ms[(int)(complete * 0.95)];
+    *p99 = ms[(int)(complete * 0.99)];
+}
+
+// stacked graph of the kept frames, the full height is two 60Hz
+// frames, whatever is left of a frame above the stages is waiting
+// (vsync mostly) and drawn grey
+void drawProfiler(int x, int y, int width, int height)
+{
+    const double range = 2.0 / 60.0;
+    DrawRectangle(x, y, width, height, (Color){ 0, 0, 0, 160 });
+    
+    float barWidth = (float)width / PROF_FRAMES;
+    for (int i = 0; i < complete; i++) {
+        const profFrame* f = finishedFrame(i);
+        float bx = x + width - (complete - i) * barWidth;
+        float base = y + height;
+        
+        float h = fminf(f->total / range, 1) * height;
+        DrawRectangleRec((Rectangle){ bx, base - h, barWidth, h }, DARKGRAY);
+        for (int s = 0; s < PROF_STAGES; s++) {
+            h = f->stage[s] / range * height;
+            if (base - h < y) h = base - y;
+            DrawRectangleRec((Rectangle){ bx, base - h, barWidth, h }, stageColors[s]);
+            base -= h;
+        }
+    }
+    // 60Hz line
+    DrawLine(x, y + height / 2, x + width, y + height / 2, WHITE);
+    
+    float p50, p95, p99;
+    profPercentiles(PROF_STAGES, &p50, &p95, &p99);
+    int ty = y + height + 4;
+    DrawText(TextFormat("frame p50 %.2f p95 %.2f p99 %.2f ms", p50, p95, p99), x, ty, 10, WHITE);
+    for (int s = 0; s < PROF_STAGES; s++) {
+        profPercentiles(s, &p50, &p95, &p99);
+        ty += 12;
+        DrawRectangle(x, ty, 8, 8, stageColors[s]);
+        DrawText(TextFormat("%s p50 %.3f p99 %.3f", stageNames[s], p50, p99), x + 12, ty, 10, WHITE);
+    }
+}
+
+// one row per kept frame, times in milliseconds
+bool saveProfileCSV(const char* fileName)
+{
+    FILE* f = fopen(fileName, "w");
+    if (!f) return false;
+    
+    fprintf(f, "frame,total");
+    for (int s = 0; s < PROF_STAGES; s++) fprintf(f, ",%s", stageNames[s]);
+    fprintf(f, "\n");
+    for (int i = 0; i < complete; i++) {
+        const profFrame* pf = finishedFrame(i);
+        fprintf(f, "%i,%.4f", i, pf->total * 1000);
+        for (int s = 0; s < PROF_STAGES; s++) fprintf(f, ",%.4f", pf->stage[s] * 1000);
+        fprintf(f, "\n");
+    }
+    fclose(f);
+    return true;
+}
+
+// chrome://tracing or perfetto json, only the time spent in each
+// stage is known so the physics stages are laid end to end from the
+// start of the frame on one track and the render stages on another
+bool saveProfileTrace(const char* fileName)
+{
+    FILE* f = fopen(fileName, "w");
+    if (!f) return false;
+    
+    fprintf(f, "{\"traceEvents\":[\n");
+    bool first = true;
+    double origin = complete ? finishedFrame(0)->start : 0;
+    for (int i = 0; i < complete; i++) {
+        const profFrame* pf = finishedFrame(i);
+        double us = (pf->start - origin) * 1e6;
+        fprintf(f, "%s{\"name\":\"frame\",\"ph\":\"X\",\"pid\":1,\"tid\":0,"
+                    "\"ts\":%.1f,\"dur\":%.1f}", first ? "" : ",\n", us, pf->total * 1e6);
+        first = false;
+        
+        double at[2] = { us, us };
+        for (int s = 0; s < PROF_STAGES; s++) {
+            int track = s < PROF_TRANSFORMS ? 0 : 1;
+            double dur = pf->stage[s] * 1e6;
+            fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%i,"
+                        "\"ts\":%.1f,\"dur\":%.1f}", stageNames[s], track + 1, at[track], dur);
+            at[track] += dur;
+        }
+    }
+    fprintf(f, "\n],\"displayTimeUnit\":\"ms\"}\n");
+    fclose(f);
+    return true;
+}
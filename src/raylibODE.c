@@ -27,43 +27,372 @@
 
 #include <ode/ode.h>
 #include "raylibODE.h"
+#include "profiler.h"
 
-// reused for all geoms that don't collide
-// ie vehicle counter weights
-static geomInfo disabled;
+#include <stdlib.h>
+#include <string.h>
 
-// optionally a geom can have user data, in this case
-// the only info our user data has is if the geom
-// should collide or not
-// this allows for bodies that effect COG without
-// colliding
-bool checkColliding(dGeomID g)
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// what each material is and what it can hit, the ground is
+// never tested against itself
+static const unsigned long matCategory[MAT_COUNT] = {
+    [MAT_PROP] = CAT_PROP, [MAT_GROUND] = CAT_GROUND,
+    [MAT_TYRE] = CAT_CAR, [MAT_CHASSIS] = CAT_CAR
+};
+static const unsigned long matCollide[MAT_COUNT] = {
+    [MAT_PROP] = CAT_GROUND | CAT_PROP | CAT_CAR, 
+    [MAT_GROUND] = CAT_PROP | CAT_CAR,
+    [MAT_TYRE] = CAT_GROUND | CAT_PROP | CAT_CAR, 
+    [MAT_CHASSIS] = CAT_GROUND | CAT_PROP | CAT_CAR
+};
+
+// attaches a geomInfo to a geom, the render side of things is
+// worked out here once as shape dimensions don't change after
+// creation, leaving only position and rotation to read each frame
+// the collision bits come from the material, a geom that isn't
+// collidable is in no category and collides with nothing so
+// the broadphase never reports it
+geomInfo* createGeomInfo(dGeomID geom, bool collidable, int material)
+{
+    geomInfo* gi = RL_MALLOC(sizeof(geomInfo));
+    gi->collidable = collidable;
+    gi->visible = collidable;
+    gi->material = material;
+    gi->model = 0;
+    gi->scale = MatrixIdentity();
+    gi->tint = WHITE;
+    gi->radius = 0;
+    gi->primed = false;
+    gi->slot = -1;
+    gi->noted = 0;
+    
+    int class = dGeomGetClass(geom);
+    if (class == dBoxClass) {
+        dVector3 size;
+        dGeomBoxGetLengths(geom, size);
+        gi->model = &box;
+        gi->scale = MatrixScale(size[0], size[1], size[2]);
+        gi->radius = 0.5 * sqrtf(size[0]*size[0] + size[1]*size[1] + size[2]*size[2]);
+    } else if (class == dSphereClass) {
+        float d = dGeomSphereGetRadius(geom) * 2;
+        gi->model = &ball;
+        gi->scale = MatrixScale(d, d, d);
+        gi->radius = d / 2;
+    } else if (class == dCylinderClass) {
+        dReal l,r;
+        dGeomCylinderGetParams (geom, &r, &l);
+        gi->model = &cylinder;
+        gi->scale = MatrixScale(r*2, r*2, l);
+        gi->radius = sqrtf(r*r + l*l/4);
+    }
+    
+    dGeomSetCategoryBits(geom, collidable ? matCategory[material] : 0);
+    dGeomSetCollideBits(geom, collidable ? matCollide[material] : 0);
+    
+    dGeomSetData(geom, gi);
+    return gi;
+}
+
+// releases the geomInfo of every geom in a space
+void freeSpaceGeomInfo(dSpaceID space)
+{
+    int ng = dSpaceGetNumGeoms(space);
+    for (int i=0; i<ng; i++) {
+        dGeomID geom = dSpaceGetGeom(space, i);
+        RL_FREE(dGeomGetData(geom));
+        dGeomSetData(geom, 0);
+    }
+}
+
+#ifndef MAX_MATERIAL_MAPS
+#define MAX_MATERIAL_MAPS 12    // raylib's default, DrawMesh looks at this many
+#endif
+
+// position rotation scale all done with the transform, meshes can stand
+// in for the model's own (levels of detail) or be NULL, the shared
+// materials are only read, anything not tinted WHITE is drawn with a
+// tinted copy of its material maps so other threads (or draws) never
+// see the colour change
+void MyDrawModel(const Model* model, const Mesh* meshes, Matrix transform, Color tint)
 {
-    geomInfo* gi = (geomInfo*)dGeomGetData(g);
-    if (!gi) return true;
-    return gi->collidable;
+    if (!meshes) meshes = model->meshes;
+    bool tinted = tint.r != 255 || tint.g != 255 || tint.b != 255 || tint.a != 255;
+    
+    for (int i = 0; i < model->meshCount; i++) {
+        const Material* material = &model->materials[model->meshMaterial[i]];
+        if (!tinted) {
+            DrawMesh(meshes[i], *material, transform);
+            continue;
+        }
+        
+        MaterialMap maps[MAX_MATERIAL_MAPS];
+        memcpy(maps, material->maps, sizeof(maps));
+        Color c = maps[MATERIAL_MAP_DIFFUSE].color;
+        maps[MATERIAL_MAP_DIFFUSE].color = (Color){ c.r * tint.r / 255, c.g * tint.g / 255,
+                                                    c.b * tint.b / 255, c.a * tint.a / 255 };
+        Material m = *material;
+        m.maps = maps;
+        DrawMesh(meshes[i], m, transform);
+    }
 }
 
-// position rotation scale all done with the models transform...
-void MyDrawModel(Model model, Color tint)
+
+// LoadModel needs a GL context to upload the mesh, this reads an obj
+// file without one so the collision can be built (or the mesh baked)
+// headless, laid out like raylib's loader three vertices per triangle
+// with the texcoords flipped the same way, polygons are fanned into
+// triangles, normals and texcoords are only filled in if the file
+// has them, release with freeObjMesh
+Mesh loadObjMesh(const char* fileName)
 {
+    Mesh mesh = { 0 };
+    char* text = LoadFileText(fileName);
+    if (!text) return mesh;
     
-    for (int i = 0; i < model.meshCount; i++)
-    {
-        Color color = model.materials[model.meshMaterial[i]].maps[MATERIAL_MAP_DIFFUSE].color;
+    // first pass just counts so everything is allocated once
+    int nPos = 0, nUv = 0, nNorm = 0, nTri = 0;
+    for (char* line = text; *line; ) {
+        if (line[0] == 'v' && line[1] == ' ') nPos++;
+        if (line[0] == 'v' && line[1] == 't') nUv++;
+        if (line[0] == 'v' && line[1] == 'n') nNorm++;
+        if (line[0] == 'f' && line[1] == ' ') {
+            int corners = 0;
+            for (char* c = line + 1; *c && *c != '\n'; ) {
+                while (*c == ' ' || *c == '\t' || *c == '\r') c++;
+                if (!*c || *c == '\n') break;
+                corners++;
+                while (*c && *c != ' ' && *c != '\t' && *c != '\n') c++;
+            }
+            if (corners > 2) nTri += corners - 2;
+        }
+        while (*line && *line != '\n') line++;
+        if (*line) line++;
+    }
+    
+    float* pos = RL_MALLOC(nPos * 3 * sizeof(float));
+    float* uv = RL_MALLOC((nUv ? nUv : 1) * 2 * sizeof(float));
+    float* norm = RL_MALLOC((nNorm ? nNorm : 1) * 3 * sizeof(float));
+    mesh.vertices = RL_MALLOC(nTri * 9 * sizeof(float));
+    if (nUv) mesh.texcoords = RL_CALLOC(nTri * 6, sizeof(float));
+    if (nNorm) mesh.normals = RL_CALLOC(nTri * 9, sizeof(float));
+    int p = 0, u = 0, n = 0, t = 0;
+    for (char* line = text; *line; ) {
+        char* c = line + 2;
+        if (line[0] == 'v' && line[1] == ' ') {
+            for (int i = 0; i < 3; i++) pos[p * 3 + i] = strtof(c, &c);
+            p++;
+        } else if (line[0] == 'v' && line[1] == 't') {
+            c = line + 3;
+            for (int i = 0; i < 2; i++) uv[u * 2 + i] = strtof(c, &c);
+            uv[u * 2 + 1] = 1.0f - uv[u * 2 + 1];
+            u++;
+        } else if (line[0] == 'v' && line[1] == 'n') {
+            c = line + 3;
+            for (int i = 0; i < 3; i++) norm[n * 3 + i] = strtof(c, &c);
+            n++;
+        } else if (line[0] == 'f' && line[1] == ' ') {
+            // position / texcoord / normal index of each corner
+            long first[3] = { -1 }, prev[3] = { -1 };
+            while (1) {
+                // strtol would happily skip onto the next line
+                while (*c == ' ' || *c == '\t' || *c == '\r') c++;
+                char* end;
+                long idx[3] = { strtol(c, &end, 10), 0, 0 };
+                if (end == c) break;
+                c = end;
+                for (int k = 1; k < 3 && *c == '/'; k++) {
+                    c++;
+                    idx[k] = strtol(c, &end, 10);
+                    c = end;
+                }
+                // negative indices count back from the last one read
+                long counts[3] = { p, u, n };
+                for (int k = 0; k < 3; k++) {
+                    idx[k] = idx[k] < 0 ? counts[k] + idx[k] : idx[k] - 1;
+                    if (idx[k] < 0 || idx[k] >= counts[k]) idx[k] = -1;
+                }
+                while (*c && *c != ' ' && *c != '\t' && *c != '\r' && *c != '\n') c++;
+                if (idx[0] < 0) continue;
+                if (first[0] < 0) {
+                    memcpy(first, idx, sizeof(idx));
+                } else if (prev[0] < 0) {
+                    memcpy(prev, idx, sizeof(idx));
+                } else {
+                    const long* tri[3] = { first, prev, idx };
+                    for (int i = 0; i < 3; i++) {
+                        int v = t * 3 + i;
+                        memcpy(&mesh.vertices[v * 3], &pos[tri[i][0] * 3], 3 * sizeof(float));
+                        if (mesh.texcoords && tri[i][1] >= 0) {
+                            memcpy(&mesh.texcoords[v * 2], &uv[tri[i][1] * 2], 2 * sizeof(float));
+                        }
+                        if (mesh.normals && tri[i][2] >= 0) {
+                            memcpy(&mesh.normals[v * 3], &norm[tri[i][2] * 3], 3 * sizeof(float));
+                        }
+                    }
+                    t++;
+                    memcpy(prev, idx, sizeof(idx));
+                }
+            }
+        }
+        while (*line && *line != '\n') line++;
+        if (*line) line++;
+    }
+    
+    mesh.vertexCount = t * 3;
+    mesh.triangleCount = t;
+    RL_FREE(pos);
+    RL_FREE(uv);
+    RL_FREE(norm);
+    UnloadFileText(text);
+    return mesh;
+}
+
+// UnloadMesh would try to release GL buffers that were never made
+void freeObjMesh(Mesh mesh)
+{
+    RL_FREE(mesh.vertices);
+    RL_FREE(mesh.texcoords);
+    RL_FREE(mesh.normals);
+}
+
 
-        Color colorTint = WHITE;
-        colorTint.r = (unsigned char)((((float)color.r/255.0)*((float)tint.r/255.0))*255.0f);
-        colorTint.g = (unsigned char)((((float)color.g/255.0)*((float)tint.g/255.0))*255.0f);
-        colorTint.b = (unsigned char)((((float)color.b/255.0)*((float)tint.b/255.0))*255.0f);
-        colorTint.a = (unsigned char)((((float)color.a/255.0)*((float)tint.a/255.0))*255.0f);
+// hash of a vertex position, -0 is folded into 0 so they match
+static unsigned int hashVertex(const float* v)
+{
+    unsigned int h = 2166136261u;
+    for (int i = 0; i < 3; i++) {
+        float f = v[i] + 0.0f;
+        unsigned int bits;
+        memcpy(&bits, &f, sizeof(bits));
+        h = (h ^ bits) * 16777619u;
+    }
+    return h;
+}
 
-        model.materials[model.meshMaterial[i]].maps[MATERIAL_MAP_DIFFUSE].color = colorTint;
-        DrawMesh(model.meshes[i], model.materials[model.meshMaterial[i]], model.transform);
-        model.materials[model.meshMaterial[i]].maps[MATERIAL_MAP_DIFFUSE].color = color;
+// models loaded from obj files have three unique vertices per
+// triangle, for collision only the positions matter so vertices
+// in the same place are merged and a real index buffer built
+// the returned vertex (3 floats each) and index arrays are
+// RL_MALLOC'd and must outlive any trimesh data built from them
+// returns the number of unique vertices, the index count is
+// always the mesh triangleCount * 3
+int weldMesh(Mesh mesh, float** outVerts, int** outInd)
+{
+    int nI = mesh.triangleCount * 3;
+    float* verts = RL_MALLOC(nI * 3 * sizeof(float));
+    int* ind = RL_MALLOC(nI * sizeof(int));
+    
+    // open addressing table of vertex indices, kept under half full
+    int tableSize = 16;
+    while (tableSize < nI * 2) tableSize *= 2;
+    int* table = RL_MALLOC(tableSize * sizeof(int));
+    for (int i = 0; i < tableSize; i++) table[i] = -1;
+    
+    int nV = 0;
+    for (int i = 0; i < nI; i++) {
+        int src = mesh.indices ? mesh.indices[i] : i;
+        const float* v = &mesh.vertices[src * 3];
+        
+        unsigned int slot = hashVertex(v) & (tableSize - 1);
+        while (table[slot] != -1) {
+            const float* w = &verts[table[slot] * 3];
+            if (w[0] == v[0] && w[1] == v[1] && w[2] == v[2]) break;
+            slot = (slot + 1) & (tableSize - 1);
+        }
+        if (table[slot] == -1) {
+            table[slot] = nV;
+            memcpy(&verts[nV * 3], v, 3 * sizeof(float));
+            nV++;
+        }
+        ind[i] = table[slot];
+    }
+    RL_FREE(table);
+    
+    *outVerts = RL_REALLOC(verts, nV * 3 * sizeof(float));
+    *outInd = ind;
+    return nV;
+}
+
+// samples an indexed triangle mesh onto a square grid of heights
+// covering its x/z extent and makes an ODE heightfield from it
+// ground contacts become a lookup in the grid rather than a walk
+// down the trimesh's AABB tree, the mesh needs to be a landscape
+// (one surface when looked at from above) for this to make sense
+heightfield* createHeightfield(dSpaceID space, const float* verts, int nV, 
+                                    const int* ind, int nI, int samples)
+{
+    Vector3 min = { verts[0], verts[1], verts[2] };
+    Vector3 max = min;
+    for (int i = 1; i < nV; i++) {
+        const float* v = &verts[i * 3];
+        min = (Vector3){ fminf(min.x, v[0]), fminf(min.y, v[1]), fminf(min.z, v[2]) };
+        max = (Vector3){ fmaxf(max.x, v[0]), fmaxf(max.y, v[1]), fmaxf(max.z, v[2]) };
+    }
+    
+    heightfield* hf = RL_MALLOC(sizeof(heightfield));
+    hf->samples = samples;
+    hf->heights = RL_MALLOC(samples * samples * sizeof(float));
+    for (int i = 0; i < samples * samples; i++) hf->heights[i] = min.y;
+    
+    float width = max.x - min.x, depth = max.z - min.z;
+    float stepX = width / (samples - 1), stepZ = depth / (samples - 1);
+    
+    // rasterise each triangle onto the grid points under it
+    for (int t = 0; t < nI; t += 3) {
+        const float* a = &verts[ind[t] * 3];
+        const float* b = &verts[ind[t+1] * 3];
+        const float* c = &verts[ind[t+2] * 3];
+        
+        float d = (b[2] - c[2]) * (a[0] - c[0]) + (c[0] - b[0]) * (a[2] - c[2]);
+        if (fabsf(d) < 1e-12f) continue;    // edge on from above
+        
+        int x0 = (int)floorf((fminf(a[0], fminf(b[0], c[0])) - min.x) / stepX);
+        int x1 = (int)ceilf((fmaxf(a[0], fmaxf(b[0], c[0])) - min.x) / stepX);
+        int z0 = (int)floorf((fminf(a[2], fminf(b[2], c[2])) - min.z) / stepZ);
+        int z1 = (int)ceilf((fmaxf(a[2], fmaxf(b[2], c[2])) - min.z) / stepZ);
+        if (x0 < 0) x0 = 0;
+        if (z0 < 0) z0 = 0;
+        if (x1 > samples - 1) x1 = samples - 1;
+        if (z1 > samples - 1) z1 = samples - 1;
+        
+        for (int z = z0; z <= z1; z++) {
+            for (int x = x0; x <= x1; x++) {
+                float px = min.x + x * stepX, pz = min.z + z * stepZ;
+                float l1 = ((b[2] - c[2]) * (px - c[0]) + (c[0] - b[0]) * (pz - c[2])) / d;
+                float l2 = ((c[2] - a[2]) * (px - c[0]) + (a[0] - c[0]) * (pz - c[2])) / d;
+                float l3 = 1 - l1 - l2;
+                const float e = -1e-4f;   // so grid points on an edge aren't missed
+                if (l1 < e || l2 < e || l3 < e) continue;
+                hf->heights[x + z * samples] = l1 * a[1] + l2 * b[1] + l3 * c[1];
+            }
+        }
     }
+    
+    // ODE doesn't copy the heights, they stay with the heightfield
+    hf->data = dGeomHeightfieldDataCreate();
+    dGeomHeightfieldDataBuildSingle(hf->data, hf->heights, 0, width, depth,
+                                        samples, samples, 1, 0, 1, 0);
+    dGeomHeightfieldDataSetBounds(hf->data, min.y, max.y);
+    
+    // heightfields are centred on their position
+    hf->geom = dCreateHeightfield(space, hf->data, 1);
+    createGeomInfo(hf->geom, true, MAT_GROUND);
+    dGeomSetPosition(hf->geom, (min.x + max.x) / 2, 0, (min.z + max.z) / 2);
+    return hf;
 }
 
+void freeHeightfield(heightfield* hf)
+{
+    dGeomDestroy(hf->geom);
+    dGeomHeightfieldDataDestroy(hf->data);
+    RL_FREE(hf->heights);
+    RL_FREE(hf);
+}
 
 // these two just convert to column major and minor
 void rayToOdeMat(Matrix* m, dReal* R) {
@@ -82,70 +411,718 @@ void odeToRayMat(const dReal* R, Matrix* m)
     m->m12 = 0;    m->m13 = 0;    m->m14 = 0;        m->m15 = 1;
 }
 
-void drawGeom(dGeomID geom) 
+// one model matrix, scale then rotate (q is x,y,z,w) then translate,
+// written straight out rather than multiplying matrices together
+static void composeTransform(Vector3 p, Quaternion q, Vector3 s, Matrix* m)
 {
-    const dReal* pos = dGeomGetPosition(geom);
-    const dReal* rot = dGeomGetRotation(geom);
-    int class = dGeomGetClass(geom);
-    Model* m = 0;
-    dVector3 size;
-    if (class == dBoxClass) {
-        m = &box;
-        dGeomBoxGetLengths(geom, size);
-    } else if (class == dSphereClass) {
-        m = &ball;
-        float r = dGeomSphereGetRadius(geom);
-        size[0] = size[1] = size[2] = (r*2);
-    } else if (class == dCylinderClass) {
-        m = &cylinder;
-        dReal l,r;
-        dGeomCylinderGetParams (geom, &r, &l);
-        size[0] = size[1] = r*2;
-        size[2] = l;
+    float xx = q.x*q.x, yy = q.y*q.y, zz = q.z*q.z;
+    float xy = q.x*q.y, xz = q.x*q.z, yz = q.y*q.z;
+    float wx = q.w*q.x, wy = q.w*q.y, wz = q.w*q.z;
+    
+    // each rotation column is multiplied by its scale
+    m->m0 = (1 - 2*(yy + zz)) * s.x;  m->m1 = 2*(xy + wz) * s.x;  m->m2 = 2*(xz - wy) * s.x;
+    m->m4 = 2*(xy - wz) * s.y;  m->m5 = (1 - 2*(xx + zz)) * s.y;  m->m6 = 2*(yz + wx) * s.y;
+    m->m8 = 2*(xz + wy) * s.z;  m->m9 = 2*(yz - wx) * s.z;  m->m10 = (1 - 2*(xx + yy)) * s.z;
+    m->m3 = 0;     m->m7 = 0;     m->m11 = 0;
+    m->m12 = p.x;  m->m13 = p.y;  m->m14 = p.z;  m->m15 = 1;
+}
+
+#if defined(__SSE__)
+typedef __m128 v4;
+#define V4ADD _mm_add_ps
+#define V4SUB _mm_sub_ps
+#define V4MUL _mm_mul_ps
+#define V4SET(a, b, c, d) _mm_set_ps(d, c, b, a)
+#elif defined(__ARM_NEON)
+typedef float32x4_t v4;
+#define V4ADD vaddq_f32
+#define V4SUB vsubq_f32
+#define V4MUL vmulq_f32
+#endif
+
+// the same for a whole array, four at a time with simd the sums are
+// done across four bodies at once and each row of their matrices is
+// then a 4x4 transpose away, what's left over goes one at a time
+void composeTransforms(const Vector3* pos, const Quaternion* rot, const Vector3* scale,
+                        Matrix* out, int count)
+{
+    int i = 0;
+#if defined(__SSE__) || defined(__ARM_NEON)
+    for (; i + 4 <= count; i += 4) {
+#if defined(__SSE__)
+        v4 x = V4SET(rot[i].x, rot[i+1].x, rot[i+2].x, rot[i+3].x);
+        v4 y = V4SET(rot[i].y, rot[i+1].y, rot[i+2].y, rot[i+3].y);
+        v4 z = V4SET(rot[i].z, rot[i+1].z, rot[i+2].z, rot[i+3].z);
+        v4 w = V4SET(rot[i].w, rot[i+1].w, rot[i+2].w, rot[i+3].w);
+        v4 px = V4SET(pos[i].x, pos[i+1].x, pos[i+2].x, pos[i+3].x);
+        v4 py = V4SET(pos[i].y, pos[i+1].y, pos[i+2].y, pos[i+3].y);
+        v4 pz = V4SET(pos[i].z, pos[i+1].z, pos[i+2].z, pos[i+3].z);
+        v4 sx = V4SET(scale[i].x, scale[i+1].x, scale[i+2].x, scale[i+3].x);
+        v4 sy = V4SET(scale[i].y, scale[i+1].y, scale[i+2].y, scale[i+3].y);
+        v4 sz = V4SET(scale[i].z, scale[i+1].z, scale[i+2].z, scale[i+3].z);
+        v4 one = _mm_set1_ps(1), two = _mm_set1_ps(2);
+#else
+        // the loads split the interleaved structs into lanes
+        float32x4x4_t q4 = vld4q_f32(&rot[i].x);
+        float32x4x3_t p3 = vld3q_f32(&pos[i].x);
+        float32x4x3_t s3 = vld3q_f32(&scale[i].x);
+        v4 x = q4.val[0], y = q4.val[1], z = q4.val[2], w = q4.val[3];
+        v4 px = p3.val[0], py = p3.val[1], pz = p3.val[2];
+        v4 sx = s3.val[0], sy = s3.val[1], sz = s3.val[2];
+        v4 one = vdupq_n_f32(1), two = vdupq_n_f32(2);
+#endif
+        v4 xx = V4MUL(x, x), yy = V4MUL(y, y), zz = V4MUL(z, z);
+        v4 xy = V4MUL(x, y), xz = V4MUL(x, z), yz = V4MUL(y, z);
+        v4 wx = V4MUL(w, x), wy = V4MUL(w, y), wz = V4MUL(w, z);
+        
+        // the first three rows of the matrices as they are in memory
+        // (m0 m4 m8 m12, m1 m5 m9 m13 ...) one body per lane
+        v4 rows[3][4] = {
+            { V4MUL(V4SUB(one, V4MUL(two, V4ADD(yy, zz))), sx), V4MUL(V4MUL(two, V4SUB(xy, wz)), sy),
+              V4MUL(V4MUL(two, V4ADD(xz, wy)), sz), px },
+            { V4MUL(V4MUL(two, V4ADD(xy, wz)), sx), V4MUL(V4SUB(one, V4MUL(two, V4ADD(xx, zz))), sy),
+              V4MUL(V4MUL(two, V4SUB(yz, wx)), sz), py },
+            { V4MUL(V4MUL(two, V4SUB(xz, wy)), sx), V4MUL(V4MUL(two, V4ADD(yz, wx)), sy),
+              V4MUL(V4SUB(one, V4MUL(two, V4ADD(xx, yy))), sz), pz }
+        };
+        for (int r = 0; r < 3; r++) {
+            v4* v = rows[r];
+#if defined(__SSE__)
+            _MM_TRANSPOSE4_PS(v[0], v[1], v[2], v[3]);
+            for (int j = 0; j < 4; j++) _mm_storeu_ps((float*)&out[i + j] + r * 4, v[j]);
+#else
+            // interleaving puts each body's row one after the other
+            float t[16];
+            vst4q_f32(t, ((float32x4x4_t){ { v[0], v[1], v[2], v[3] } }));
+            for (int j = 0; j < 4; j++) vst1q_f32((float*)&out[i + j] + r * 4, vld1q_f32(&t[j * 4]));
+#endif
+        }
+        for (int j = 0; j < 4; j++) {
+            out[i + j].m3 = 0;  out[i + j].m7 = 0;  out[i + j].m11 = 0;  out[i + j].m15 = 1;
+        }
+    }
+#endif
+    for (; i < count; i++) composeTransform(pos[i], rot[i], scale[i], &out[i]);
+}
+
+// culling and level of detail, balls and cylinders have cheaper
+// meshes for when they're small on screen, anything outside the
+// view or smaller than a pixel isn't drawn at all
+enum { BUCKET_BOX, BUCKET_BALL, BUCKET_CYLINDER, BUCKET_MODELS };
+
+// level 0 is the model's own mesh, a box is already as
+// simple as it gets so only has the one level
+static Mesh lodMeshes[BUCKET_MODELS][LOD_LEVELS];
+static int lodLevels[BUCKET_MODELS];
+
+// projected radius in pixels below which the next level is used
+static const float lodPixels[LOD_LEVELS - 1] = { 24, 8 };
+static const float cullPixels = 0.75;
+
+static struct {
+    bool active;
+    Vector4 planes[6];
+    Vector3 eye;
+    float pixelScale;   // pixels per unit of radius over distance
+} view;
+
+static renderStats stats;
+
+static int modelKind(const Model* m)
+{
+    if (m == &box) return BUCKET_BOX;
+    if (m == &ball) return BUCKET_BALL;
+    if (m == &cylinder) return BUCKET_CYLINDER;
+    return -1;
+}
+
+// GenMeshCylinder stands on its base along y, ODE cylinders
+// are centred along z the same as data/cylinder.obj
+static Mesh genOdeCylinder(int slices)
+{
+    Mesh mesh = GenMeshCylinder(0.5, 1, slices);
+    for (int i = 0; i < mesh.vertexCount; i++) {
+        float* v = &mesh.vertices[i * 3];
+        float* n = &mesh.normals[i * 3];
+        float y = v[1];
+        v[1] = -v[2];
+        v[2] = y - 0.5;
+        y = n[1];
+        n[1] = -n[2];
+        n[2] = y;
     }
-    if (!m) return;
+    // GenMesh* has already uploaded it
+    UpdateMeshBuffer(mesh, 0, mesh.vertices, mesh.vertexCount * 3 * sizeof(float), 0);
+    UpdateMeshBuffer(mesh, 2, mesh.normals, mesh.vertexCount * 3 * sizeof(float), 0);
+    return mesh;
+}
+
+// needs to be called after the models have been loaded
+void initLods(void)
+{
+    Model* models[BUCKET_MODELS] = { &box, &ball, &cylinder };
+    for (int i = 0; i < BUCKET_MODELS; i++) {
+        lodMeshes[i][0] = models[i]->meshes[0];
+        lodLevels[i] = 1;
+    }
+    lodMeshes[BUCKET_BALL][1] = GenMeshSphere(.5, 16, 16);
+    lodMeshes[BUCKET_BALL][2] = GenMeshSphere(.5, 8, 8);
+    lodLevels[BUCKET_BALL] = 3;
+    lodMeshes[BUCKET_CYLINDER][1] = genOdeCylinder(16);
+    lodMeshes[BUCKET_CYLINDER][2] = genOdeCylinder(8);
+    lodLevels[BUCKET_CYLINDER] = 3;
+}
+
+void freeLods(void)
+{
+    // level 0 belongs to the model
+    for (int i = 0; i < BUCKET_MODELS; i++) {
+        for (int l = 1; l < lodLevels[i]; l++) UnloadMesh(lodMeshes[i][l]);
+        lodLevels[i] = 0;
+    }
+}
+
+// a plane from two rows of the clip matrix, normalised so
+// distances to it are in world units
+static Vector4 clipPlane(Vector4 a, Vector4 b, float sign)
+{
+    Vector4 p = { a.x + b.x * sign, a.y + b.y * sign, a.z + b.z * sign, a.w + b.w * sign };
+    float l = sqrtf(p.x*p.x + p.y*p.y + p.z*p.z);
+    return (Vector4){ p.x / l, p.y / l, p.z / l, p.w / l };
+}
+
+// call between BeginMode3D and EndMode3D, the camera is picked up
+// from rlgl, when cull is false everything is drawn at full detail
+void setRenderView(bool cull)
+{
+    stats = (renderStats){0};
+    view.active = cull;
+    if (!cull) return;
     
-    Matrix matScale = MatrixScale(size[0], size[1], size[2]);
-    Matrix matRot;
-    odeToRayMat(rot, &matRot);
-    Matrix matTran = MatrixTranslate(pos[0], pos[1], pos[2]);
+    Matrix mv = rlGetMatrixModelview();
+    Matrix proj = rlGetMatrixProjection();
+    Matrix m = MatrixMultiply(mv, proj);
     
-    m->transform = MatrixMultiply(MatrixMultiply(matScale, matRot), matTran);
+    // Gribb & Hartmann, the frustum planes straight from the
+    // rows of the combined view projection matrix
+    Vector4 r0 = { m.m0, m.m4, m.m8, m.m12 };
+    Vector4 r1 = { m.m1, m.m5, m.m9, m.m13 };
+    Vector4 r2 = { m.m2, m.m6, m.m10, m.m14 };
+    Vector4 r3 = { m.m3, m.m7, m.m11, m.m15 };
+    view.planes[0] = clipPlane(r3, r0, 1);     // left
+    view.planes[1] = clipPlane(r3, r0, -1);    // right
+    view.planes[2] = clipPlane(r3, r1, 1);     // bottom
+    view.planes[3] = clipPlane(r3, r1, -1);    // top
+    view.planes[4] = clipPlane(r3, r2, 1);     // near
+    view.planes[5] = clipPlane(r3, r2, -1);    // far
     
-    dBodyID b = dGeomGetBody(geom);
-    Color c = WHITE;
-    if (b) if (!dBodyIsEnabled(b)) c = RED;
+    Matrix inv = MatrixInvert(mv);
+    view.eye = (Vector3){ inv.m12, inv.m13, inv.m14 };
+    // m5 is 1 / tan(fovy / 2)
+    view.pixelScale = proj.m5 * GetScreenHeight() / 2;
+}
+
+// what was drawn since the last setRenderView
+renderStats getRenderStats(void)
+{
+    return stats;
+}
 
-    MyDrawModel(*m, c);
-    m->transform = MatrixIdentity();
+// the level to draw a geom at p with or -1 if it can't be seen
+static int geomLod(const geomInfo* gi, Vector3 p)
+{
+    if (!view.active) {
+        stats.drawn++;
+        stats.lods[0]++;
+        return 0;
+    }
+    
+    for (int i = 0; i < 6; i++) {
+        const Vector4* pl = &view.planes[i];
+        if (pl->x * p.x + pl->y * p.y + pl->z * p.z + pl->w < -gi->radius) {
+            stats.culled++;
+            return -1;
+        }
+    }
+    
+    float dist = Vector3Distance(p, view.eye);
+    int lod = 0;
+    if (dist > gi->radius) {
+        float pixels = gi->radius / dist * view.pixelScale;
+        if (pixels < cullPixels) {
+            stats.culled++;
+            return -1;
+        }
+        int levels = lodLevels[modelKind(gi->model)];
+        while (lod < levels - 1 && pixels < lodPixels[lod]) lod++;
+    }
+    stats.drawn++;
+    stats.lods[lod]++;
+    return lod;
+}
+
+// the scale matrices are only ever a scale
+static Vector3 geomScale(const geomInfo* gi)
+{
+    return (Vector3){ gi->scale.m0, gi->scale.m5, gi->scale.m10 };
+}
+
+static void drawGeomInfo(const geomInfo* gi, Matrix transform, bool enabled, int lod)
+{
+    // the shared model is left alone, the level and transform are passed in
+    const Mesh* meshes = lod ? &lodMeshes[modelKind(gi->model)][lod] : NULL;
+    MyDrawModel(gi->model, meshes, transform, enabled ? gi->tint : RED);
+}
+
+// every drawable geom has a fixed slot in the snapshots, given out the
+// first time its space is captured, after that a snapshot only copies
+// the geoms updated since it was last captured rather than walking the
+// whole space, the slots updated before each capture are kept for a
+// few captures back and a snapshot older than that is copied whole
+#define SNAP_HISTORY 8
+
+static struct {
+    dSpaceID space;
+    int spaceGeoms;     // in the space when the slots were given out
+    int unprimed;       // drawable but not given a slot yet
+    geomInfo** slots;
+    int count;
+    int* updated[SNAP_HISTORY];     // slots updated before each capture
+    int updatedCount[SNAP_HISTORY];
+    unsigned int captures;
+} snapSlots;
+
+// a geom left with a slot from a space no longer captured is ignored
+static void noteGeomUpdate(geomInfo* gi)
+{
+    unsigned int c = snapSlots.captures;
+    if (gi->slot < 0 || gi->slot >= snapSlots.count || snapSlots.slots[gi->slot] != gi) return;
+    if (gi->noted == c) return;
+    gi->noted = c;
+    snapSlots.updated[c % SNAP_HISTORY][snapSlots.updatedCount[c % SNAP_HISTORY]++] = gi->slot;
 }
 
-void drawAllSpaceGeoms(dSpaceID space) 
+// a geom is only given a slot once it has a transform to copy
+static void assignSnapSlots(dSpaceID space)
 {
     int ng = dSpaceGetNumGeoms(space);
+    snapSlots.slots = RL_REALLOC(snapSlots.slots, ng * sizeof(geomInfo*));
+    for (int h = 0; h < SNAP_HISTORY; h++) {
+        snapSlots.updated[h] = RL_REALLOC(snapSlots.updated[h], ng * sizeof(int));
+        snapSlots.updatedCount[h] = 0;
+    }
+    snapSlots.space = space;
+    snapSlots.spaceGeoms = ng;
+    snapSlots.count = snapSlots.unprimed = 0;
     for (int i=0; i<ng; i++) {
-        dGeomID geom = dSpaceGetGeom(space, i);
-        if (checkColliding(geom))  
-        {
-            // hide non colliding geoms (car counter weights)
-            drawGeom(geom);
+        geomInfo* gi = (geomInfo*)dGeomGetData(dSpaceGetGeom(space, i));
+        if (!gi) continue;
+        gi->slot = -1;
+        // hide non colliding geoms (car counter weights)
+        if (!gi->model || !gi->visible) continue;
+        if (!gi->primed) {
+            snapSlots.unprimed++;
+            continue;
         }
+        gi->slot = snapSlots.count;
+        gi->noted = 0;
+        snapSlots.slots[snapSlots.count++] = gi;
+    }
+    // far enough on that every snapshot taken before is copied whole
+    snapSlots.captures += SNAP_HISTORY + 1;
+}
+
+// the count of captures carries on so any snapshot still
+// around is copied whole the next time it's captured
+void freeSnapSlots(void)
+{
+    RL_FREE(snapSlots.slots);
+    snapSlots.slots = 0;
+    for (int h = 0; h < SNAP_HISTORY; h++) {
+        RL_FREE(snapSlots.updated[h]);
+        snapSlots.updated[h] = 0;
     }
+    snapSlots.space = 0;
+    snapSlots.count = 0;
 }
 
 
-vehicle* CreateVehicle(dSpaceID space, dWorldID world)
+// keeps the last two stepped transforms of a drawable geom
+static void updateGeomState(dGeomID geom)
 {
-    // TODO these should be parameters
-    Vector3 carScale = (Vector3){2.5, 0.5, 1.4};
-    float wheelRadius = 0.5, wheelWidth = 0.45;
+    geomInfo* gi = (geomInfo*)dGeomGetData(geom);
+    if (!gi || !gi->model) return;
     
-    vehicle* car = RL_MALLOC(sizeof(vehicle));
+    memcpy(gi->prevPos, gi->pos, sizeof(gi->pos));
+    memcpy(gi->prevQ, gi->q, sizeof(dQuaternion));
+    memcpy(gi->pos, dGeomGetPosition(geom), sizeof(gi->pos));
+    dGeomGetQuaternion(geom, gi->q);
+    dBodyID b = dGeomGetBody(geom);
+    gi->enabled = b ? dBodyIsEnabled(b) : true;
+    
+    // nothing to interpolate from yet
+    if (!gi->primed) {
+        memcpy(gi->prevPos, gi->pos, sizeof(gi->pos));
+        memcpy(gi->prevQ, gi->q, sizeof(dQuaternion));
+        gi->primed = true;
+    }
+    noteGeomUpdate(gi);
+}
+
+// call for every geom after every step or at least once to 
+// prime them, for sleeping bodies both transforms end up the same
+void updateGeomStates(dSpaceID space)
+{
+    int ng = dSpaceGetNumGeoms(space);
+    for (int i=0; i<ng; i++) updateGeomState(dSpaceGetGeom(space, i));
+}
+
+// the same for just the geoms of one body, if only the bodies that
+// moved are updated they must also be updated once as they go to sleep
+void updateBodyGeomStates(dBodyID body)
+{
+    for (dGeomID g = dBodyGetFirstGeom(body); g; g = dBodyGetNextGeom(g)) {
+        updateGeomState(g);
+    }
+}
+
+static void copyGeomState(geomState* gs, geomInfo* gi)
+{
+    gs->info = gi;
+    memcpy(gs->pos, gi->pos, sizeof(gs->pos));
+    memcpy(gs->prevPos, gi->prevPos, sizeof(gs->prevPos));
+    memcpy(gs->q, gi->q, sizeof(dQuaternion));
+    memcpy(gs->prevQ, gi->prevQ, sizeof(dQuaternion));
+    gs->enabled = gi->enabled;
+}
+
+// copies the stepped state of all the drawable geoms in a space, 
+// once captured the snapshot can be drawn without touching ODE
+// so it can be handed from the physics thread to the renderer
+// only one space can be captured, capturing another starts over
+void captureSpaceGeoms(dSpaceID space, geomSnapshot* snap)
+{
+    if (space != snapSlots.space || snapSlots.unprimed
+            || dSpaceGetNumGeoms(space) != snapSlots.spaceGeoms) assignSnapSlots(space);
+    
+    unsigned int c = snapSlots.captures;
+    if (snap->stamp && c - snap->stamp < SNAP_HISTORY) {
+        // the captures it missed and this one
+        for (unsigned int h = snap->stamp; h != c + 1; h++) {
+            const int* updated = snapSlots.updated[h % SNAP_HISTORY];
+            int n = snapSlots.updatedCount[h % SNAP_HISTORY];
+            for (int i = 0; i < n; i++) {
+                copyGeomState(&snap->geoms[updated[i]], snapSlots.slots[updated[i]]);
+            }
+        }
+    } else {
+        if (snapSlots.count > snap->capacity) {
+            snap->capacity = snapSlots.count;
+            snap->geoms = RL_REALLOC(snap->geoms, snap->capacity * sizeof(geomState));
+        }
+        for (int i = 0; i < snapSlots.count; i++) copyGeomState(&snap->geoms[i], snapSlots.slots[i]);
+        snap->count = snapSlots.count;
+    }
+    snap->stamp = c + 1;
+    
+    // updates from here on are for the next capture
+    snapSlots.captures = c + 1;
+    snapSlots.updatedCount[(c + 1) % SNAP_HISTORY] = 0;
+}
+
+// position of a captured geom part way (alpha 0-1) between
+// its previous and current step
+static Vector3 statePosition(const geomState* gs, float alpha)
+{
+    Vector3 p = { gs->pos[0], gs->pos[1], gs->pos[2] };
+    if (alpha < 1) {
+        Vector3 pp = { gs->prevPos[0], gs->prevPos[1], gs->prevPos[2] };
+        p = Vector3Lerp(pp, p, alpha);
+    }
+    return p;
+}
+
+// and its rotation
+static Quaternion stateRotation(const geomState* gs, float alpha)
+{
+    // NB ODE quaternions are w,x,y,z raylib's are x,y,z,w
+    Quaternion q = { gs->q[1], gs->q[2], gs->q[3], gs->q[0] };
+    if (alpha < 1) {
+        Quaternion pq = { gs->prevQ[1], gs->prevQ[2], gs->prevQ[3], gs->prevQ[0] };
+        q = QuaternionSlerp(pq, q, alpha);
+    }
+    return q;
+}
+
+
+void freeSnapshot(geomSnapshot* snap)
+{
+    RL_FREE(snap->geoms);
+    snap->geoms = 0;
+    snap->count = snap->capacity = 0;
+    snap->stamp = 0;
+}
+
+// the arrays drawSnapshot gathers into, only ever grown so a frame
+// with no more geoms than the busiest so far doesn't allocate
+static void* drawScratch;
+static int drawScratchCapacity;
+
+// everything that's visible is gathered up first so the
+// transforms can all be built in one batch
+void drawSnapshot(const geomSnapshot* snap, float alpha)
+{
+    double t = getClock();
+    if (snap->count > drawScratchCapacity) {
+        drawScratchCapacity = snap->count * 2;
+        drawScratch = RL_REALLOC(drawScratch, drawScratchCapacity * (2 * sizeof(Vector3) 
+                        + sizeof(Quaternion) + sizeof(Matrix) + 2 * sizeof(int)));
+    }
+    int n = 0, cap = drawScratchCapacity;
+    Vector3* pos = drawScratch;
+    Matrix* transforms = (Matrix*)(pos + cap);
+    Quaternion* rot = (Quaternion*)(transforms + cap);
+    Vector3* scale = (Vector3*)(rot + cap);
+    int* index = (int*)(scale + cap);
+    int* lods = index + cap;
+    
+    for (int i=0; i<snap->count; i++) {
+        const geomState* gs = &snap->geoms[i];
+        Vector3 p = statePosition(gs, alpha);
+        int lod = geomLod(gs->info, p);
+        if (lod < 0) continue;
+        
+        pos[n] = p;
+        rot[n] = stateRotation(gs, alpha);
+        scale[n] = geomScale(gs->info);
+        index[n] = i;
+        lods[n] = lod;
+        n++;
+    }
+    composeTransforms(pos, rot, scale, transforms, n);
+    profAdd(PROF_TRANSFORMS, getClock() - t);
+    
+    for (int i = 0; i < n; i++) {
+        const geomState* gs = &snap->geoms[index[i]];
+        drawGeomInfo(gs->info, transforms[i], gs->enabled, lods[i]);
+    }
+}
+
+// instanced rendering, geoms are put in a bucket for their model
+// and level of detail, then each bucket is drawn with one call
+// the instance shader builds the model matrix itself so what goes
+// in each instance's matrix is really four vec4s, position, rotation
+// (x,y,z,w), scale and tint, no matrix maths on the cpu at all
+#define BUCKET_COUNT (BUCKET_MODELS * LOD_LEVELS)
+
+typedef struct instanceBucket {
+    const Mesh* mesh;
+    Material material;
+    Matrix* transforms;
+    int count;
+    int capacity;
+} instanceBucket;
+
+static instanceBucket buckets[BUCKET_COUNT];
+
+static void initBucket(instanceBucket* b, Model* m, const Mesh* mesh, Shader shader)
+{
+    b->mesh = mesh;
+    b->material = LoadMaterialDefault();
+    b->material.shader = shader;
+    b->material.maps[MATERIAL_MAP_DIFFUSE].texture = 
+                    m->materials[0].maps[MATERIAL_MAP_DIFFUSE].texture;
+    b->transforms = 0;
+    b->count = 0;
+    b->capacity = 0;
+}
+
+// needs to be called after the models have been loaded and textured
+// and initLods, the shader must have SHADER_LOC_MATRIX_MODEL pointing
+// at its instance attribute
+void initInstancing(Shader instShader)
+{
+    Model* models[BUCKET_MODELS] = { &box, &ball, &cylinder };
+    for (int i = 0; i < BUCKET_MODELS; i++) {
+        for (int l = 0; l < LOD_LEVELS; l++) {
+            // models without a level share the closest one
+            const Mesh* mesh = &lodMeshes[i][l < lodLevels[i] ? l : lodLevels[i] - 1];
+            initBucket(&buckets[i * LOD_LEVELS + l], models[i], mesh, instShader);
+        }
+    }
+}
+
+// the lighting variant can change at run time, the buckets only hold
+// a copy of the shader so they have to be told
+void setInstancingShader(Shader instShader)
+{
+    for (int i = 0; i < BUCKET_COUNT; i++) buckets[i].material.shader = instShader;
+}
+
+void freeInstancing(void)
+{
+    for (int i = 0; i < BUCKET_COUNT; i++) {
+        // the shader and textures belong to the models so
+        // only the map array and transforms are released
+        RL_FREE(buckets[i].material.maps);
+        RL_FREE(buckets[i].transforms);
+        buckets[i].material.maps = 0;
+        buckets[i].transforms = 0;
+        buckets[i].capacity = 0;
+    }
+    // along with the non instanced draw's scratch
+    RL_FREE(drawScratch);
+    drawScratch = 0;
+    drawScratchCapacity = 0;
+}
+
+// q is x,y,z,w, the scale matrices are only ever a scale
+static void addGeomInstance(const geomInfo* gi, Vector3 p, Quaternion q, bool enabled, int lod)
+{
+    instanceBucket* b = &buckets[modelKind(gi->model) * LOD_LEVELS + lod];
+    if (b->count == b->capacity) {
+        b->capacity = b->capacity ? b->capacity * 2 : 64;
+        b->transforms = RL_REALLOC(b->transforms, b->capacity * sizeof(Matrix));
+    }
+    
+    Vector4 c = ColorNormalize(enabled ? gi->tint : RED);
+    Matrix* m = &b->transforms[b->count++];
+    // each column is one vec4 in the shader
+    m->m0 = p.x;   m->m1 = p.y;   m->m2 = p.z;    m->m3 = 1;
+    m->m4 = q.x;   m->m5 = q.y;   m->m6 = q.z;    m->m7 = q.w;
+    Vector3 s = geomScale(gi);
+    m->m8 = s.x;   m->m9 = s.y;   m->m10 = s.z;   m->m11 = 0;
+    m->m12 = c.x;  m->m13 = c.y;  m->m14 = c.z;   m->m15 = c.w;
+}
+
+static void drawBuckets(void)
+{
+    for (int i = 0; i < BUCKET_COUNT; i++) {
+        instanceBucket* b = &buckets[i];
+        if (!b->count) continue;
+        DrawMeshInstanced(*b->mesh, b->material, b->transforms, b->count);
+        b->count = 0;
+    }
+}
+
+void drawSnapshotInstanced(const geomSnapshot* snap, float alpha)
+{
+    double t = getClock();
+    for (int i=0; i<snap->count; i++) {
+        const geomState* gs = &snap->geoms[i];
+        Vector3 p = statePosition(gs, alpha);
+        int lod = geomLod(gs->info, p);
+        if (lod < 0) continue;
+        
+        addGeomInstance(gs->info, p, stateRotation(gs, alpha), gs->enabled, lod);
+    }
+    profAdd(PROF_TRANSFORMS, getClock() - t);
+    drawBuckets();
+}
+
+// the original hand tuned car
+vehicleParams defaultVehicleParams(void)
+{
+    vehicleParams p = {
+        .position = { 15, 6, 15.5 },
+        .chassis = { 2.5, 0.5, 1.4 },
+        .chassisMass = 150,
+        .counterWeightMass = 150,
+        .counterWeightRadius = 1,
+        .counterWeightDrop = 2,
+        .wheelRadius = 0.5,
+        .wheelWidth = 0.45,
+        .wheelMass = 2,
+        .wheelBase = 2.4,
+        .trackWidth = 2,
+        .wheelDrop = 0.5,
+        .steerLimit = 0.5,
+        .steerForce = 500,
+        .driveForce = 1500,
+        .suspensionERP = 0.9,
+        .suspensionCFM = 0.002,
+        .raycast = false,
+        // the car weighs about 300kg so sits ~0.15 down on its springs
+        .springRate = 5000,
+        .springDamping = 600,
+        .tyreStiffness = 4000,
+        .tyreGrip = 1.5
+    };
+    return p;
+}
+
+// where a raycast wheel hangs, steered and rolled, relative to the chassis
+static void placeRaycastWheel(vehicle* car, int i, dReal drop)
+{
+    const dReal* wo = car->wheelOffsets[i];
+    dGeomSetOffsetPosition(car->geoms[i+1], wo[0], -drop, wo[2]);
+    // the cylinders axle is its z, steering turns it about -y
+    dQuaternion steer, spin, q;
+    dQFromAxisAndAngle(steer, 0, -1, 0, i < 2 ? car->steerAngle : 0);
+    dQFromAxisAndAngle(spin, 0, 0, 1, car->spin[i]);
+    dQMultiply0(q, steer, spin);
+    dGeomSetOffsetQuaternion(car->geoms[i+1], q);
+}
+
+typedef struct wheelHit {
+    dContactGeom contact;       // depth is how far along the ray
+    bool hit;
+} wheelHit;
+
+static void wheelRayCallback(void* data, dGeomID o1, dGeomID o2)
+{
+    wheelHit* h = data;
+    dContactGeom cg;
+    if (dCollide(o1, o2, 1, &cg, sizeof(dContactGeom)) && (!h->hit || cg.depth < h->contact.depth)) {
+        h->contact = cg;
+        h->hit = true;
+    }
+}
+
+// the wheels are rays down from where the suspension mounts on the
+// chassis, each ray long enough to reach the bottom of a wheel hanging
+// at wheelDrop, the cylinders only show where the rays put them
+static void initRaycastWheels(vehicle* car)
+{
+    const vehicleParams* p = &car->params;
+    for (int i = 0; i < 4; i++) {
+        car->bodies[i+1] = NULL;
+        car->joints[i] = NULL;
+        car->spin[i] = 0;
+        car->geoms[i+1] = dCreateCylinder(dGeomGetSpace(car->geoms[0]), p->wheelRadius, p->wheelWidth);
+        dGeomSetBody(car->geoms[i+1], car->bodies[0]);
+        // seen but not collided, the rays do that
+        createGeomInfo(car->geoms[i+1], false, MAT_TYRE)->visible = true;
+        placeRaycastWheel(car, i, p->wheelDrop);
+        car->rays[i] = dCreateRay(0, p->wheelDrop + p->wheelRadius);
+    }
+}
+
+// builds a car in place, car can be part of an array
+static void initVehicle(vehicle* car, dSpaceID space, dSpaceID groundSpace, 
+                            dWorldID world, const vehicleParams* p)
+{
+    car->params = *p;
+    Vector3 carScale = p->chassis;
+    Vector3 cp = p->position;
+
+    // 0 front left, 1 front right, 2 rear left, 3 rear right
+    for (int i = 0; i < 4; i++) {
+        car->wheelOffsets[i][0] = (i < 2 ? 1 : -1) * p->wheelBase / 2;
+        car->wheelOffsets[i][1] = -p->wheelDrop;
+        car->wheelOffsets[i][2] = (i % 2 ? 1 : -1) * p->trackWidth / 2;
+    }
+    // nothing has been sent to the drive motors yet
+    car->driven = false;
+    car->kinematic = false;
+    car->groundSpace = groundSpace;
+    car->stepSize = 1.0 / 240.0;
+    car->steerAngle = 0;
     
     // car body
     dMass m;
     dMassSetBox(&m, 1, carScale.x, carScale.y, carScale.z);  // density
-    dMassAdjust(&m, 150); // mass
+    dMassAdjust(&m, p->chassisMass); // mass
     
     car->bodies[0] = dBodyCreate(world);
     dBodySetMass(car->bodies[0], &m);
@@ -154,31 +1131,37 @@ vehicle* CreateVehicle(dSpaceID space, dWorldID world)
 
     car->geoms[0] = dCreateBox(space, carScale.x, carScale.y, carScale.z);
     dGeomSetBody(car->geoms[0], car->bodies[0]);
+    createGeomInfo(car->geoms[0], true, MAT_CHASSIS);
     
-    // TODO used a little later and should be a parameter
-    dBodySetPosition(car->bodies[0], 15, 6, 15.5);
+    dBodySetPosition(car->bodies[0], cp.x, cp.y, cp.z);
     
     dGeomID front = dCreateBox(space, 0.5, 0.5, 0.5);
     dGeomSetBody(front, car->bodies[0]);
+    createGeomInfo(front, true, MAT_CHASSIS);
     dGeomSetOffsetPosition(front, carScale.x/2-0.25, carScale.y/2+0.25 , 0);
     
+    dMassAdjust(&m, p->counterWeightMass);
     car->bodies[5] = dBodyCreate(world);
     dBodySetMass(car->bodies[5], &m);
     dBodySetAutoDisableFlag( car->bodies[5], 0 );
-    // see previous TODO
-    dBodySetPosition(car->bodies[5], 15, 6-2, 15.5);
-    car->geoms[5] = dCreateSphere(space,1);
+    dBodySetPosition(car->bodies[5], cp.x, cp.y - p->counterWeightDrop, cp.z);
+    car->geoms[5] = dCreateSphere(space, p->counterWeightRadius);
     dGeomSetBody(car->geoms[5],car->bodies[5]);
-    disabled.collidable = false;
-    dGeomSetData(car->geoms[5], &disabled);
+    // counter weight effects COG but doesn't collide
+    createGeomInfo(car->geoms[5], false, MAT_CHASSIS);
     
     car->joints[5] = dJointCreateFixed (world, 0);
     dJointAttach(car->joints[5], car->bodies[0], car->bodies[5]);
     dJointSetFixed (car->joints[5]);
     
+    if (p->raycast) {
+        initRaycastWheels(car);
+        return;
+    }
+    
     // wheels
-    dMassSetCylinder(&m, 1, 3, wheelRadius, wheelWidth);
-    dMassAdjust(&m, 2); // mass
+    dMassSetCylinder(&m, 1, 3, p->wheelRadius, p->wheelWidth);
+    dMassAdjust(&m, p->wheelMass); // mass
     dQuaternion q;
     dQFromAxisAndAngle(q, 0, 0, 1, M_PI * 0.5);
     for(int i = 1; i <= 4; ++i)
@@ -186,19 +1169,16 @@ vehicle* CreateVehicle(dSpaceID space, dWorldID world)
         car->bodies[i] = dBodyCreate(world);
         dBodySetMass(car->bodies[i], &m);
         dBodySetQuaternion(car->bodies[i], q);
-        car->geoms[i] = dCreateCylinder(space, wheelRadius, wheelWidth);
+        car->geoms[i] = dCreateCylinder(space, p->wheelRadius, p->wheelWidth);
         dGeomSetBody(car->geoms[i], car->bodies[i]);
+        createGeomInfo(car->geoms[i], true, MAT_TYRE);
         dBodySetFiniteRotationMode( car->bodies[i], 1 );
             dBodySetAutoDisableFlag( car->bodies[i], 0 );
+        
+        const dReal* wo = car->wheelOffsets[i-1];
+        dBodySetPosition(car->bodies[i], cp.x + wo[0], cp.y + wo[1], cp.z + wo[2]);
     }
 
-    const dReal* cp = dBodyGetPosition(car->bodies[0]);
-    // TODO wheel base and axel width should be parameters
-    dBodySetPosition(car->bodies[1], cp[0]+1.2, cp[1]-.5, cp[2]-1); 
-    dBodySetPosition(car->bodies[2], cp[0]+1.2, cp[1]-.5, cp[2]+1); 
-    dBodySetPosition(car->bodies[3], cp[0]-1.2, cp[1]-.5, cp[2]-1); 
-    dBodySetPosition(car->bodies[4], cp[0]-1.2, cp[1]-.5, cp[2]+1); 
-
     // hinge2 (combined steering / suspension / motor !)
     for(int i = 0; i < 4; ++i)
     {
@@ -219,21 +1199,21 @@ vehicle* CreateVehicle(dSpaceID space, dWorldID world)
         dJointSetHinge2Param(car->joints[i], dParamHiStop, 0);
         dJointSetHinge2Param(car->joints[i], dParamLoStop, 0);
         dJointSetHinge2Param(car->joints[i], dParamHiStop, 0);
-        dJointSetHinge2Param(car->joints[i], dParamFMax, 1500);
+        dJointSetHinge2Param(car->joints[i], dParamFMax, p->driveForce);
 
         dJointSetHinge2Param(car->joints[i], dParamVel2, dInfinity);
-        dJointSetHinge2Param(car->joints[i], dParamFMax2, 1500);
+        dJointSetHinge2Param(car->joints[i], dParamFMax2, p->driveForce);
 
-        dJointSetHinge2Param(car->joints[i], dParamSuspensionERP, 0.9);
-        dJointSetHinge2Param(car->joints[i], dParamSuspensionCFM, 0.002);
+        dJointSetHinge2Param(car->joints[i], dParamSuspensionERP, p->suspensionERP);
+        dJointSetHinge2Param(car->joints[i], dParamSuspensionCFM, p->suspensionCFM);
 
         // steering
         if (i<2) {
-            dJointSetHinge2Param (car->joints[i],dParamFMax,500);
-            dJointSetHinge2Param (car->joints[i],dParamLoStop,-0.5);
-            dJointSetHinge2Param (car->joints[i],dParamHiStop,0.5);
-            dJointSetHinge2Param (car->joints[i],dParamLoStop,-0.5);
-            dJointSetHinge2Param (car->joints[i],dParamHiStop,0.5);
+            dJointSetHinge2Param (car->joints[i],dParamFMax,p->steerForce);
+            dJointSetHinge2Param (car->joints[i],dParamLoStop,-p->steerLimit);
+            dJointSetHinge2Param (car->joints[i],dParamHiStop,p->steerLimit);
+            dJointSetHinge2Param (car->joints[i],dParamLoStop,-p->steerLimit);
+            dJointSetHinge2Param (car->joints[i],dParamHiStop,p->steerLimit);
             dJointSetHinge2Param (car->joints[i],dParamFudgeFactor,0.1);
         }
         
@@ -241,29 +1221,127 @@ vehicle* CreateVehicle(dSpaceID space, dWorldID world)
     // disable motor on front wheels
     dJointSetHinge2Param(car->joints[0], dParamFMax2, 0);
     dJointSetHinge2Param(car->joints[1], dParamFMax2, 0);
+}
 
-    return car;
+// springs hold the chassis up on the rays and the tyres push along
+// where the wheel points and against it sliding sideways, all as
+// forces on the chassis so there's no wheel for the solver
+static void updateRaycastVehicle(vehicle *car, float accel, float maxAccelForce, 
+                    float steer, float steerFactor)
+{
+    const vehicleParams* p = &car->params;
+    dBodyID chassis = car->bodies[0];
+    float dt = car->stepSize;
+    float length = p->wheelDrop + p->wheelRadius;
+    
+    // like the hinge2 motor chasing the target angle
+    car->steerAngle += (steer - car->steerAngle) * fminf(1, steerFactor * dt);
+    car->steerAngle = Clamp(car->steerAngle, -p->steerLimit, p->steerLimit);
+    float driveForce = fabs(accel) > 0.1 ? maxAccelForce / p->wheelRadius : 0;
+    car->accel = accel;
+    car->driveTarget = fabs(accel) > 0.1 ? maxAccelForce : 0;
+    car->driven = true;
+    
+    dVector3 up;
+    dBodyVectorToWorld(chassis, 0, 1, 0, up);
+    for (int i = 0; i < 4; i++) {
+        const dReal* wo = car->wheelOffsets[i];
+        dVector3 mount;
+        dBodyGetRelPointPos(chassis, wo[0], 0, wo[2], mount);
+        dGeomRaySet(car->rays[i], mount[0], mount[1], mount[2], -up[0], -up[1], -up[2]);
+        wheelHit h = { .hit = false };
+        if (car->groundSpace) dSpaceCollide2(car->rays[i], (dGeomID)car->groundSpace, &h, wheelRayCallback);
+        
+        if (!h.hit) {
+            placeRaycastWheel(car, i, p->wheelDrop);
+            continue;
+        }
+        const dReal* cp = h.contact.pos;
+        dReal n[3] = { h.contact.normal[0], h.contact.normal[1], h.contact.normal[2] };
+        if (n[0] * up[0] + n[1] * up[1] + n[2] * up[2] < 0) {
+            n[0] = -n[0]; n[1] = -n[1]; n[2] = -n[2];
+        }
+        
+        dVector3 pv;
+        dBodyGetPointVel(chassis, cp[0], cp[1], cp[2], pv);
+        float compress = length - h.contact.depth;
+        float closing = -(pv[0] * up[0] + pv[1] * up[1] + pv[2] * up[2]);
+        float load = fmaxf(0, p->springRate * compress + p->springDamping * closing);
+        
+        // where the wheel points, flat on the ground
+        float a = i < 2 ? car->steerAngle : 0;
+        dVector3 wf;
+        dBodyVectorToWorld(chassis, cosf(a), 0, sinf(a), wf);
+        float wn = wf[0] * n[0] + wf[1] * n[1] + wf[2] * n[2];
+        for (int j = 0; j < 3; j++) wf[j] -= n[j] * wn;
+        float wl = sqrtf(wf[0] * wf[0] + wf[1] * wf[1] + wf[2] * wf[2]);
+        
+        // pointing straight into the ground the tyre has no grip
+        // to give but the spring still holds the car up
+        float vf = 0, fl = 0, fs = 0;
+        dReal side[3] = { 0, 0, 0 };
+        if (wl >= 0.001f) {
+            for (int j = 0; j < 3; j++) wf[j] /= wl;
+            side[0] = n[1] * wf[2] - n[2] * wf[1];
+            side[1] = n[2] * wf[0] - n[0] * wf[2];
+            side[2] = n[0] * wf[1] - n[1] * wf[0];
+            vf = pv[0] * wf[0] + pv[1] * wf[1] + pv[2] * wf[2];
+            float vs = pv[0] * side[0] + pv[1] * side[1] + pv[2] * side[2];
+            
+            // only the rear wheels are driven, the fronts roll freely
+            if (i >= 2) fl = Clamp((accel * p->wheelRadius - vf) * p->tyreStiffness, -driveForce, driveForce);
+            fs = -vs * p->tyreStiffness;
+            float limit = p->tyreGrip * load;
+            float f = sqrtf(fl * fl + fs * fs);
+            if (f > limit) {
+                fl *= limit / f;
+                fs *= limit / f;
+            }
+        }
+        dBodyAddForceAtPos(chassis, up[0] * load + wf[0] * fl + side[0] * fs,
+                                    up[1] * load + wf[1] * fl + side[1] * fs,
+                                    up[2] * load + wf[2] * fl + side[2] * fs,
+                                    cp[0], cp[1], cp[2]);
+        
+        car->spin[i] -= vf / p->wheelRadius * dt;
+        placeRaycastWheel(car, i, h.contact.depth - p->wheelRadius);
+    }
 }
 
 
 void updateVehicle(vehicle *car, float accel, float maxAccelForce, 
                     float steer, float steerFactor)
 {
+    if (car->params.raycast) {
+        updateRaycastVehicle(car, accel, maxAccelForce, steer, steerFactor);
+        return;
+    }
+    
     float target;
     target = 0;
     if (fabs(accel) > 0.1) target = maxAccelForce;
     
-    dJointSetHinge2Param( car->joints[0], dParamVel2, -accel );
-    dJointSetHinge2Param( car->joints[1], dParamVel2, accel );
-    
-    dJointSetHinge2Param( car->joints[2], dParamVel2, -accel );
-    dJointSetHinge2Param( car->joints[3], dParamVel2, accel );
+    // setting a joint param isn't free, most steps the throttle
+    // hasn't changed since the last one so leave the motors alone
+    if (!car->driven || accel != car->accel) {
+        dJointSetHinge2Param( car->joints[0], dParamVel2, -accel );
+        dJointSetHinge2Param( car->joints[1], dParamVel2, accel );
+        
+        dJointSetHinge2Param( car->joints[2], dParamVel2, -accel );
+        dJointSetHinge2Param( car->joints[3], dParamVel2, accel );
+        car->accel = accel;
+    }
 
     //dJointSetHinge2Param( car->joints[0], dParamFMax2, target );
     //dJointSetHinge2Param( car->joints[1], dParamFMax2, target );
-    dJointSetHinge2Param( car->joints[2], dParamFMax2, target );
-    dJointSetHinge2Param( car->joints[3], dParamFMax2, target );
+    if (!car->driven || target != car->driveTarget) {
+        dJointSetHinge2Param( car->joints[2], dParamFMax2, target );
+        dJointSetHinge2Param( car->joints[3], dParamFMax2, target );
+        car->driveTarget = target;
+    }
+    car->driven = true;
     
+    // the steering motor chases the target angle so changes every step
     for(int i=0;i<2;i++) {
         dReal v = steer - dJointGetHinge2Angle1 (car->joints[i]);
         v *= steerFactor;
@@ -282,19 +1360,185 @@ void unflipVehicle (vehicle *car)
     dRFromEulerAngles(newR, 0, -atan2(-R[2],R[0]) , 0);
     dBodySetRotation(car->bodies[0], newR);
     
-    // wheel offsets
-    // TODO make configurable & use in vehicle set up 
-    dReal wheelOffsets[4][3] = {
-           { +1.2, -.6, -1 },
-           { +1.2, -.6, +1 },
-           { -1.2, -.6, -1 },
-           { -1.2, -.6, +1 }
-        };
-
+    // a little lower than they were built so they settle
+    // onto the suspension rather than sit above it
+    if (car->params.raycast) return;
     for (int i=1; i<5; i++) {
+        const dReal* wo = car->wheelOffsets[i-1];
         dVector3 pb;
-        dBodyGetRelPointPos(car->bodies[0], wheelOffsets[i-1][0], wheelOffsets[i-1][1], wheelOffsets[i-1][2], pb);
+        dBodyGetRelPointPos(car->bodies[0], wo[0], wo[1] - 0.1, wo[2], pb);
         dBodySetPosition(car->bodies[i], pb[0], pb[1], pb[2]);
     }
 
 }
+
+
+// a car too far away to be seen in any detail isn't worth its rig of
+// joints, it's switched to a kinematic body that drives itself and
+// the wheels are carried along with it, switching back gives the rig
+// the kinematic motion so it carries on from where it was
+void setVehicleKinematic(vehicle* car, bool kinematic)
+{
+    if (car->kinematic == kinematic) return;
+    dBodyID chassis = car->bodies[0];
+    
+    if (kinematic) {
+        const dReal* cq = dBodyGetQuaternion(chassis);
+        for (int i = 1; i < 6; i++) {
+            if (!car->bodies[i]) continue;
+            const dReal* p = dBodyGetPosition(car->bodies[i]);
+            dBodyGetPosRelPoint(chassis, p[0], p[1], p[2], car->rigPos[i-1]);
+            dQMultiply1(car->rigQ[i-1], cq, dBodyGetQuaternion(car->bodies[i]));
+        }
+        const dReal* v = dBodyGetLinearVel(chassis);
+        dVector3 fwd;
+        dBodyVectorToWorld(chassis, 1, 0, 0, fwd);
+        car->speed = v[0] * fwd[0] + v[1] * fwd[1] + v[2] * fwd[2];
+        car->ride = NAN;
+        for (int i = 0; i < 6; i++) {
+            if (car->bodies[i]) dBodySetKinematic(car->bodies[i]);
+            if (car->joints[i]) dJointDisable(car->joints[i]);
+        }
+    } else {
+        for (int i = 0; i < 6; i++) {
+            if (car->bodies[i]) dBodySetDynamic(car->bodies[i]);
+            if (car->joints[i]) dJointEnable(car->joints[i]);
+        }
+        // the motors were left alone while it was kinematic
+        car->driven = false;
+    }
+    car->kinematic = kinematic;
+}
+
+// moves a kinematic car for the next step, the step integrates the
+// velocities given here, speed eases towards what the drive motors
+// would reach and it turns like a bicycle with the front wheels at
+// steer, groundY under the chassis is NAN to hold its height and
+// -INFINITY when there's nothing there to stop it falling
+void driveKinematicVehicle(vehicle* car, float accel, float steer, dReal groundY, float dt)
+{
+    const vehicleParams* p = &car->params;
+    dBodyID chassis = car->bodies[0];
+    const dReal* cp = dBodyGetPosition(chassis);
+    const dReal* cq = dBodyGetQuaternion(chassis);
+    
+    // the motors drive the wheels at accel radians a second
+    float target = accel * p->wheelRadius;
+    car->speed += (target - car->speed) * fminf(1, dt * 0.5f);
+    
+    dVector3 fwd, up;
+    dBodyVectorToWorld(chassis, 1, 0, 0, fwd);
+    dBodyVectorToWorld(chassis, 0, 1, 0, up);
+    float fl = sqrtf(fwd[0] * fwd[0] + fwd[2] * fwd[2]);
+    if (fl < 0.001f) fl = 1;
+    
+    dReal vy = 0;
+    if (groundY == -INFINITY) {
+        vy = dBodyGetLinearVel(chassis)[1] - 9.8 * dt;
+    } else if (!isnan(groundY)) {
+        if (isnan(car->ride)) car->ride = cp[1] - groundY;
+        vy = (groundY + car->ride - cp[1]) * 0.2f / dt;
+    }
+    dReal v[3] = { fwd[0] / fl * car->speed, vy, fwd[2] / fl * car->speed };
+    
+    // positive steer turns the front wheels about -y, and anything
+    // the rig was leaning at when it switched levels out
+    float angle = Clamp(steer, -p->steerLimit, p->steerLimit);
+    float yawRate = car->speed * tanf(angle) / p->wheelBase;
+    dReal w[3] = { -up[2] * 2, -yawRate, up[0] * 2 };
+    
+    dBodySetLinearVel(chassis, v[0], v[1], v[2]);
+    dBodySetAngularVel(chassis, w[0], w[1], w[2]);
+    
+    // put the rest of the rig back where it belongs so it doesn't
+    // drift, moving with the chassis
+    for (int i = 1; i < 6; i++) {
+        dBodyID b = car->bodies[i];
+        if (!b) continue;
+        const dReal* rp = car->rigPos[i-1];
+        dVector3 wp;
+        dQuaternion q;
+        dBodyGetRelPointPos(chassis, rp[0], rp[1], rp[2], wp);
+        dQMultiply0(q, cq, car->rigQ[i-1]);
+        dBodySetPosition(b, wp[0], wp[1], wp[2]);
+        dBodySetQuaternion(b, q);
+        dReal r[3] = { wp[0] - cp[0], wp[1] - cp[1], wp[2] - cp[2] };
+        dBodySetLinearVel(b, v[0] + w[1] * r[2] - w[2] * r[1],
+                            v[1] + w[2] * r[0] - w[0] * r[2],
+                            v[2] + w[0] * r[1] - w[1] * r[0]);
+        dBodySetAngularVel(b, w[0], w[1], w[2]);
+    }
+}
+
+
+// a fleet keeps its cars and their controls in contiguous arrays,
+// params holds one entry per car
+vehicleFleet* createFleet(dSpaceID space, dSpaceID groundSpace, dWorldID world, 
+                            const vehicleParams* params, int count)
+{
+    vehicleFleet* fleet = RL_MALLOC(sizeof(vehicleFleet));
+    fleet->count = count;
+    fleet->cars = RL_MALLOC(count * sizeof(vehicle));
+    fleet->accel = RL_CALLOC(count, sizeof(float));
+    fleet->steer = RL_CALLOC(count, sizeof(float));
+    for (int i = 0; i < count; i++) {
+        initVehicle(&fleet->cars[i], space, groundSpace, world, &params[i]);
+    }
+    return fleet;
+}
+
+// drives every car from the fleets accel and steer arrays
+void updateFleet(vehicleFleet* fleet, float maxAccelForce, float steerFactor)
+{
+    const float* accel = fleet->accel;
+    const float* steer = fleet->steer;
+    for (int i = 0; i < fleet->count; i++) {
+        // kinematic cars are driven by driveKinematicVehicle
+        if (fleet->cars[i].kinematic) continue;
+        updateVehicle(&fleet->cars[i], accel[i], maxAccelForce, steer[i], steerFactor);
+    }
+}
+
+// the ODE objects go with the world and space, apart
+// from the rays which aren't in one
+void freeFleet(vehicleFleet* fleet)
+{
+    for (int i = 0; i < fleet->count; i++) {
+        vehicle* car = &fleet->cars[i];
+        if (!car->params.raycast) continue;
+        for (int w = 0; w < 4; w++) dGeomDestroy(car->rays[w]);
+    }
+    RL_FREE(fleet->steer);
+    RL_FREE(fleet->accel);
+    RL_FREE(fleet->cars);
+    RL_FREE(fleet);
+}
+
+
+// spreads island stepping over a pool of worker threads
+// ODE needs to be built with its built in threading implementation
+// (the default) for this to do anything
+physThreading* createPhysThreading(dWorldID world, int count)
+{
+    physThreading* pt = RL_MALLOC(sizeof(physThreading));
+    pt->count = count;
+    pt->impl = dThreadingAllocateMultiThreadedImplementation();
+    // each worker gets its own ODE thread data, collision data isn't
+    // needed as dSpaceCollide still runs on the calling thread
+    pt->pool = dThreadingAllocateThreadPool(count, 0, dAllocateFlagBasicData, NULL);
+    dThreadingThreadPoolServeMultiThreadedImplementation(pt->pool, pt->impl);
+    
+    dWorldSetStepIslandsProcessingMaxThreadCount(world, count);
+    dWorldSetStepThreadingImplementation(world, 
+                    dThreadingImplementationGetFunctions(pt->impl), pt->impl);
+    return pt;
+}
+
+void freePhysThreading(physThreading* pt, dWorldID world)
+{
+    dThreadingImplementationShutdownProcessing(pt->impl);
+    dThreadingFreeThreadPool(pt->pool);
+    dWorldSetStepThreadingImplementation(world, NULL, NULL);
+    dThreadingFreeImplementation(pt->impl);
+    RL_FREE(pt);
+}
@@ -0,0 +1,1370 @@
+/*
+ * Copyright (c) 2021 Chris Camacho (codifies -  http://bedroomcoders.co.uk/)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include "raylib.h"
+#include "raymath.h"
+
+#include <ode/ode.h>
+#include "raylibODE.h"
+#include "terrain.h"
+#include "sim.h"
+#include "profiler.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+// each context keeps its own random numbers so the scene a seed
+// gives doesn't depend on what other threads are doing
+static float simRand(simContext* sim)
+{
+    // numerical recipes lcg, top 24 bits are plenty for a float
+    sim->rng = (sim->rng * 1664525UL + 1013904223UL) & 0xffffffffUL;
+    return (sim->rng >> 8) / (float)(1 << 24);
+}
+
+static float simRndf(simContext* sim, float min, float max) 
+{
+    return simRand(sim) * (max - min) + min;
+}
+
+
+// when objects potentially collide this callback is called
+// you can rule out certain collisions or use different surface parameters
+// depending what object types collide.... lots of flexibility and power here!
+#define MAX_CONTACTS 8
+
+// getting these just so can sometimes be a little bit of a black art!
+// one set of surface parameters for each pair of materials, built
+// once and only copied for the contacts that are generated
+static dSurfaceParameters surfaces[MAT_COUNT][MAT_COUNT];
+
+static void setSurface(int m1, int m2, dSurfaceParameters sp)
+{
+    surfaces[m1][m2] = surfaces[m2][m1] = sp;
+}
+
+static void initSurfaces(void)
+{
+    // the tyre grip the vehicle was tuned with
+    const dSurfaceParameters tyre = {
+        .mode = dContactSlip1 | dContactSlip2 |
+                dContactSoftERP | dContactSoftCFM | dContactApprox1,
+        .mu = 1000,
+        .slip1 = 0.0001,
+        .slip2 = 0.001,
+        .soft_erp = 0.05,
+        .soft_cfm = 0.0003
+    };
+    // crates and drums sliding and tumbling about
+    const dSurfaceParameters prop = {
+        .mode = dContactSoftERP | dContactSoftCFM | dContactApprox1,
+        .mu = 0.8,
+        .soft_erp = 0.2,
+        .soft_cfm = 0.0003
+    };
+    // bit of a bounce off the ground
+    dSurfaceParameters ground = prop;
+    ground.mode |= dContactBounce;
+    ground.mu = 1;
+    ground.bounce = 0.1;
+    ground.bounce_vel = 0.1;
+    // a car on its roof should slide rather than stick
+    dSurfaceParameters chassis = prop;
+    chassis.mu = 0.5;
+
+    for (int i = 0; i < MAT_COUNT; i++) {
+        for (int j = 0; j < MAT_COUNT; j++) surfaces[i][j] = prop;
+    }
+    setSurface(MAT_PROP, MAT_GROUND, ground);
+    setSurface(MAT_TYRE, MAT_GROUND, tyre);
+    setSurface(MAT_TYRE, MAT_PROP, tyre);
+    setSurface(MAT_CHASSIS, MAT_GROUND, chassis);
+}
+
+// the most contacts worth generating for each pair of geom classes
+// a sphere only ever touches at one point, more than a few contacts
+// between boxes mostly adds LCP rows for no gain
+static int contactCaps[dGeomNumClasses][dGeomNumClasses];
+
+static void setContactCap(int c1, int c2, int cap)
+{
+    contactCaps[c1][c2] = contactCaps[c2][c1] = cap;
+}
+
+static void initContactCaps(void)
+{
+    for (int i = 0; i < dGeomNumClasses; i++) {
+        for (int j = 0; j < dGeomNumClasses; j++) contactCaps[i][j] = 4;
+    }
+    for (int i = 0; i < dGeomNumClasses; i++) setContactCap(dSphereClass, i, 1);
+    setContactCap(dSphereClass, dTriMeshClass, 2);
+    setContactCap(dSphereClass, dHeightfieldClass, 2);
+    // wheels need a good contact patch on the ground
+    setContactCap(dCylinderClass, dTriMeshClass, MAX_CONTACTS);
+    setContactCap(dCylinderClass, dHeightfieldClass, MAX_CONTACTS);
+}
+
+static void nearCallback(void *data, dGeomID o1, dGeomID o2)
+{
+    simContext* sim = data;
+    collideStats* stats = &sim->collide;
+    int i;
+    stats->pairs++;
+
+    // exit without doing anything if the two bodies are connected by a joint
+    dBodyID b1 = dGeomGetBody(o1);
+    dBodyID b2 = dGeomGetBody(o2);
+    //if (b1==b2) return;
+    if (b1 && b2 && dAreConnectedExcluding(b1, b2, dJointTypeContact)) {
+        stats->connected++;
+        return;
+    }
+    // a kinematic car isn't pushed by the ground or another kinematic
+    // car, but a prop asleep in its way has to wake up to be pushed
+    bool k1 = !b1 || dBodyIsKinematic(b1);
+    bool k2 = !b2 || dBodyIsKinematic(b2);
+    if (k1 && k2) {
+        stats->still++;
+        return;
+    }
+    if (b1 && k1 && !dBodyIsEnabled(b2)) dBodyEnable(b2);
+    if (b2 && k2 && !dBodyIsEnabled(b1)) dBodyEnable(b1);
+        
+    // every geom in the scene has a geomInfo, ones that shouldn't
+    // collide have already been dropped by their collide bits
+    const geomInfo* g1 = (geomInfo*)dGeomGetData(o1);
+    const geomInfo* g2 = (geomInfo*)dGeomGetData(o2);
+
+    dContactGeom cg[MAX_CONTACTS]; // up to MAX_CONTACTS contacts per body-body
+    int c1 = dGeomGetClass(o1);
+    int c2 = dGeomGetClass(o2);
+    int cap = contactCaps[c1][c2];
+    bool timing = sim->cfg.collideTiming;
+    double t = timing ? getClock() : 0;
+    int numc = dCollide(o1, o2, cap, cg, sizeof(dContactGeom));
+    if (c1 > c2) {
+        int c = c1;
+        c1 = c2;
+        c2 = c;
+    }
+    if (c2 < COLLIDE_CLASSES) {
+        stats->tests[c1][c2]++;
+        stats->contacts[c1][c2] += numc;
+        if (timing) stats->time[c1][c2] += getClock() - t;
+    }
+    const dSurfaceParameters* sp = &surfaces[g1->material][g2->material];
+    // only a prop resting on something can be put to sleep early
+    if (numc && sim->cfg.lodFar > 0) {
+        if (g1->material == MAT_PROP) sim->touching[((propRef*)dBodyGetData(b1))->index] = true;
+        if (g2->material == MAT_PROP) sim->touching[((propRef*)dBodyGetData(b2))->index] = true;
+    }
+    for (i = 0; i < numc; i++) {
+        dContact contact;
+        contact.surface = *sp;
+        contact.geom = cg[i];
+        dJointID c = dJointCreateContact(sim->world, sim->contactgroup, &contact);
+        dJointAttach(c, b1, b2);
+    }
+
+}
+
+// ODE's step memory comes from a single preallocated arena shared
+// by every world, the allocator functions aren't given any context
+// so the arena is global and worlds stepped on other threads take
+// the lock to use it
+// ODE keeps its step memory from one step to the next and only asks
+// for more when a step needs more than it reserved, freed blocks are
+// kept in a list to be handed out again and the top of the arena
+// comes back down as the blocks under it are freed, so growing the
+// reservation doesn't leave the old block stranded
+typedef struct arenaBlock {
+    size_t size;
+    struct arenaBlock* next;
+} arenaBlock;
+
+static struct {
+    unsigned char* base;
+    size_t size, used;
+    arenaBlock* freed;
+    unsigned long fallbacks;    // blocks that had to come from malloc
+    pthread_mutex_t lock;
+} arena = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static bool inArena(const void* p)
+{
+    const unsigned char* c = p;
+    return arena.base && c >= arena.base && c < arena.base + arena.size;
+}
+
+static size_t arenaRound(size_t size)
+{
+    return (size + 15) & ~(size_t)15;
+}
+
+// call with the lock held, sizes already rounded
+static void arenaRelease(unsigned char* p, size_t size)
+{
+    if (p + size != arena.base + arena.used) {
+        arenaBlock* b = (arenaBlock*)p;
+        b->size = size;
+        b->next = arena.freed;
+        arena.freed = b;
+        return;
+    }
+    // off the top, along with any freed blocks that were under it
+    arena.used -= size;
+    bool lowered = true;
+    while (lowered) {
+        lowered = false;
+        for (arenaBlock** b = &arena.freed; *b; b = &(*b)->next) {
+            if ((unsigned char*)*b + (*b)->size == arena.base + arena.used) {
+                arena.used -= (*b)->size;
+                *b = (*b)->next;
+                lowered = true;
+                break;
+            }
+        }
+    }
+}
+
+static void* arenaAlloc(dsizeint size)
+{
+    size = arenaRound(size);
+    void* p = NULL;
+    pthread_mutex_lock(&arena.lock);
+    // the first freed block big enough, what it doesn't need goes back
+    for (arenaBlock** b = &arena.freed; *b; b = &(*b)->next) {
+        arenaBlock* f = *b;
+        if (f->size < size) continue;
+        *b = f->next;
+        if (f->size > size) arenaRelease((unsigned char*)f + size, f->size - size);
+        p = f;
+        break;
+    }
+    if (!p && arena.used + size <= arena.size) {
+        p = arena.base + arena.used;
+        arena.used += size;
+    }
+    bool first = false;
+    if (!p) first = !arena.fallbacks++;
+    pthread_mutex_unlock(&arena.lock);
+    
+    if (p) return p;
+    if (first) TraceLog(LOG_WARNING, "ODE: Step memory arena is full, falling back to malloc, try a bigger --arena");
+    return RL_MALLOC(size);
+}
+
+static void* arenaShrink(void* p, dsizeint size, dsizeint smaller)
+{
+    if (!inArena(p)) return RL_REALLOC(p, smaller);
+    size = arenaRound(size);
+    smaller = arenaRound(smaller);
+    if (smaller < size) {
+        pthread_mutex_lock(&arena.lock);
+        arenaRelease((unsigned char*)p + smaller, size - smaller);
+        pthread_mutex_unlock(&arena.lock);
+    }
+    return p;
+}
+
+static void arenaFree(void* p, dsizeint size)
+{
+    if (!inArena(p)) {
+        RL_FREE(p);
+        return;
+    }
+    pthread_mutex_lock(&arena.lock);
+    arenaRelease(p, arenaRound(size));
+    pthread_mutex_unlock(&arena.lock);
+}
+
+// call before any worlds are created, without it ODE uses its own
+// allocator
+void initStepArena(size_t bytes)
+{
+    arena.base = RL_MALLOC(bytes);
+    arena.size = bytes;
+    arena.used = 0;
+    arena.freed = NULL;
+    arena.fallbacks = 0;
+}
+
+// only once every world has been destroyed
+void freeStepArena(void)
+{
+    RL_FREE(arena.base);
+    arena.base = 0;
+    arena.size = arena.used = 0;
+    arena.freed = NULL;
+}
+
+void stepArenaUsage(size_t* used, unsigned long* fallbacks)
+{
+    pthread_mutex_lock(&arena.lock);
+    *used = arena.used;
+    *fallbacks = arena.fallbacks;
+    pthread_mutex_unlock(&arena.lock);
+}
+
+// ODE calls this for each body it steps, islands can be stepped
+// on several threads at once so the append has to be atomic
+static void propMoved(dBodyID b)
+{
+    simContext* sim = ((propRef*)dBodyGetData(b))->sim;
+    int i = __atomic_fetch_add(&sim->awakeCount, 1, __ATOMIC_RELAXED);
+    sim->awake[i] = b;
+}
+
+// a raycast car has gaps where the wheel bodies would be
+static void saveBodies(const dBodyID* bodies, bodyState* state, int count)
+{
+    for (int i = 0; i < count; i++) {
+        dBodyID b = bodies[i];
+        bodyState* s = &state[i];
+        if (!b) continue;
+        memcpy(s->pos, dBodyGetPosition(b), sizeof(s->pos));
+        memcpy(s->q, dBodyGetQuaternion(b), sizeof(s->q));
+        memcpy(s->vel, dBodyGetLinearVel(b), sizeof(s->vel));
+        memcpy(s->avel, dBodyGetAngularVel(b), sizeof(s->avel));
+        s->enabled = dBodyIsEnabled(b);
+    }
+}
+
+static void restoreBodies(dBodyID* bodies, const bodyState* state, int count)
+{
+    for (int i = 0; i < count; i++) {
+        dBodyID b = bodies[i];
+        const bodyState* s = &state[i];
+        if (!b) continue;
+        dBodySetPosition(b, s->pos[0], s->pos[1], s->pos[2]);
+        dBodySetQuaternion(b, s->q);
+        dBodySetLinearVel(b, s->vel[0], s->vel[1], s->vel[2]);
+        dBodySetAngularVel(b, s->avel[0], s->avel[1], s->avel[2]);
+        dBodySetForce(b, 0, 0, 0);
+        dBodySetTorque(b, 0, 0, 0);
+        // enabling also restarts the auto disable countdown
+        if (s->enabled) dBodyEnable(b); else dBodyDisable(b);
+    }
+}
+
+// keeps the ground around every car resident
+static void streamTerrain(simContext* sim, bool wait)
+{
+    for (int c = 0; c < sim->fleet->count; c++) {
+        const dReal* p = dBodyGetPosition(sim->fleet->cars[c].bodies[0]);
+        sim->carCentres[c] = (Vector3){ p[0], p[1], p[2] };
+    }
+    updateTerrain(sim->tiles, sim->staticSpace, sim->carCentres, sim->fleet->count,
+                    sim->cfg.terrainRadius, wait);
+}
+
+// extract just the roll of a car
+float carRoll(const vehicle* v)
+{
+    const dReal* q = dBodyGetQuaternion(v->bodies[0]);
+    float z0 = 2.0f*(q[0]*q[3] + q[1]*q[2]);
+    float z1 = 1.0f - 2.0f*(q[1]*q[1] + q[3]*q[3]);
+    return atan2f(z0, z1);
+}
+
+// the space everything that moves goes in, verts are the ground's
+// the box the ground's vertices sit in
+static void groundBounds(const float* verts, int nV, Vector3* lo, Vector3* hi)
+{
+    *lo = *hi = (Vector3){ verts[0], verts[1], verts[2] };
+    for (int i = 1; i < nV; i++) {
+        Vector3 v = { verts[i*3], verts[i*3+1], verts[i*3+2] };
+        *lo = Vector3Min(*lo, v);
+        *hi = Vector3Max(*hi, v);
+    }
+}
+
+static dSpaceID createDynamicSpace(const simConfig* cfg, const float* verts, int nV)
+{
+    if (cfg->broadphase == BROAD_SAP) {
+        // sorted along x, the flat ground means z is the next best
+        // axis to prune on, y being the thin band everything sits in
+        return dSweepAndPruneSpaceCreate(NULL, dSAP_AXES_XZY);
+    }
+    
+    if (cfg->broadphase == BROAD_QUADTREE) {
+        // sized to the ground, anything outside lives in the root block
+        Vector3 lo, hi;
+        groundBounds(verts, nV, &lo, &hi);
+        // leave room above the ground for things thrown in the air
+        hi.y += 20;
+        dVector3 centre = { (lo.x + hi.x) / 2, (lo.y + hi.y) / 2, (lo.z + hi.z) / 2 };
+        dVector3 extents = { (hi.x - lo.x) / 2, (hi.y - lo.y) / 2, (hi.z - lo.z) / 2 };
+        // NB ODE's quadtree divides on its first two axes (it expects
+        // z up) so with y up it really only splits along x
+        return dQuadTreeSpaceCreate(NULL, centre, extents, cfg->quadTreeDepth);
+    }
+    
+    // cells from 2^min to 2^max, the defaults are -3 to 10
+    // which is far bigger than anything that moves here
+    dSpaceID space = dHashSpaceCreate(NULL);
+    dHashSpaceSetLevels(space, cfg->hashMinLevel, cfg->hashMaxLevel);
+    return space;
+}
+
+// builds the world, the ground collision from groundMesh, the cars
+// and the props, ODE must already be initialised
+// the ground is already welded, the arrays are used as they are
+// (and not freed) so they have to outlive the context
+simContext* createSimGround(const simConfig* cfg, const float* verts, int nV,
+                                const int* ind, int nI)
+{
+    // the tables are shared by every context and never change
+    static bool tablesReady = false;
+    if (!tablesReady) {
+        initContactCaps();
+        initSurfaces();
+        tablesReady = true;
+    }
+    
+    simContext* sim = RL_CALLOC(1, sizeof(simContext));
+    sim->cfg = *cfg;
+    sim->rng = cfg->seed;
+    
+    sim->world = dWorldCreate();
+    
+    // reserve more step memory than asked for so a busier step
+    // doesn't mean going back to the allocator
+    dWorldStepReserveInfo reserve = { sizeof(reserve), 1.5, 1 << 20 };
+    dWorldSetStepMemoryReservationPolicy(sim->world, &reserve);
+    if (arena.base) {
+        dWorldStepMemoryFunctionsInfo mem = { sizeof(mem), arenaAlloc, arenaShrink, arenaFree };
+        dWorldSetStepMemoryManager(sim->world, &mem);
+    }
+    
+    // independant islands (piles of bodies) can be stepped in parallel
+    if (cfg->physThreads > 1) sim->threading = createPhysThreading(sim->world, cfg->physThreads);
+    
+    sim->groundVerts = verts;
+    sim->groundInd = ind;
+    
+    // a space can have multiple "worlds" for example you might have different
+    // sub levels that never interact, or the inside and outside of a building
+    // here the ground that never moves is kept apart from everything else
+    sim->staticSpace = dSimpleSpaceCreate(NULL);
+    sim->space = createDynamicSpace(cfg, sim->groundVerts, nV);
+    // the size is ignored, the group allocates in chunks as it fills
+    // and keeps them when emptied, so it's filled to the budget once
+    // here and steps that stay within it never allocate
+    sim->contactgroup = dJointGroupCreate(0);
+    int budget = cfg->contactBudget ? cfg->contactBudget 
+                        : cfg->numObj * 4 + cfg->numCars * 4 * MAX_CONTACTS;
+    dContact warm = { 0 };
+    for (int i = 0; i < budget; i++) dJointCreateContact(sim->world, sim->contactgroup, &warm);
+    dJointGroupEmpty(sim->contactgroup);
+    dWorldSetGravity(sim->world, 0, -9.8, 0);    // gravity
+    
+    dWorldSetAutoDisableFlag (sim->world, 1);
+    dWorldSetAutoDisableLinearThreshold (sim->world, 0.05);
+    dWorldSetAutoDisableAngularThreshold (sim->world, 0.05);
+    dWorldSetAutoDisableSteps (sim->world, 4);
+
+
+    // the cars line up in a square grid centred on the ground, the player
+    // in the first corner, closing up the gaps if a big fleet wouldn't fit
+    Vector3 lo, hi;
+    groundBounds(sim->groundVerts, nV, &lo, &hi);
+    int side = ceilf(sqrtf(cfg->numCars));
+    float gapX = fminf(6, (hi.x - lo.x - 10) / side);
+    float gapZ = fminf(4, (hi.z - lo.z - 10) / side);
+    float startX = (lo.x + hi.x + gapX * (side - 1)) / 2;
+    float startZ = (lo.z + hi.z - gapZ * (side - 1)) / 2;
+    vehicleParams* params = RL_MALLOC(cfg->numCars * sizeof(vehicleParams));
+    for (int i = 0; i < cfg->numCars; i++) {
+        params[i] = defaultVehicleParams();
+        params[i].position.x = startX - gapX * (i % side);
+        params[i].position.z = startZ + gapZ * (i / side);
+        params[i].raycast = cfg->raycastCars;
+    }
+    sim->fleet = createFleet(sim->space, sim->staticSpace, sim->world, params, cfg->numCars);
+    RL_FREE(params);
+    sim->car = &sim->fleet->cars[0];
+    sim->carFlipped = RL_CALLOC(cfg->numCars, sizeof(int));
+    sim->carSpawn = RL_MALLOC(cfg->numCars * 6 * sizeof(bodyState));
+    for (int c = 0; c < cfg->numCars; c++) {
+        saveBodies(sim->fleet->cars[c].bodies, &sim->carSpawn[c * 6], 6);
+    }
+    
+    if (cfg->groundHeightfield) {
+        sim->groundHf = createHeightfield(sim->staticSpace, sim->groundVerts, nV, 
+                                    sim->groundInd, nI, cfg->heightfieldSamples);
+    } else if (cfg->terrainTiles > 0) {
+        // the ground is only there around the cars, start with
+        // enough built for them and anything placed close by
+        sim->tiles = createTerrain(sim->groundVerts, nV, sim->groundInd, nI,
+                                    cfg->terrainTiles, cfg->groundPreprocess);
+        sim->carCentres = RL_MALLOC(cfg->numCars * sizeof(Vector3));
+        streamTerrain(sim, true);
+    } else {
+        // static tri mesh data to geom
+        sim->triData = dGeomTriMeshDataCreate();
+        dGeomTriMeshDataBuildSingle(sim->triData, sim->groundVerts,
+                                3 * sizeof(float), nV,
+                                sim->groundInd, nI,
+                                3 * sizeof(int));
+        if (cfg->groundPreprocess) {
+            // face angles let ODE drop contacts on internal edges
+            dGeomTriMeshDataPreprocess2(sim->triData, 
+                        (1U << dTRIDATAPREPROCESS_BUILD_FACE_ANGLES), NULL);
+        }
+        dGeomID groundGeom = dCreateTriMesh(sim->staticSpace, sim->triData, NULL, NULL, NULL);
+        createGeomInfo(groundGeom, true, MAT_GROUND);
+        if (cfg->groundPreprocess) {
+            // reuse last step's results for the shapes that support it
+            dGeomTriMeshEnableTC(groundGeom, dSphereClass, 1);
+            dGeomTriMeshEnableTC(groundGeom, dBoxClass, 1);
+        }
+    }
+    
+
+    // create the physics bodies
+    sim->obj = RL_MALLOC(cfg->numObj * sizeof(dBodyID));
+    sim->awake = RL_MALLOC(cfg->numObj * sizeof(dBodyID));
+    sim->wasAwake = RL_MALLOC(cfg->numObj * sizeof(dBodyID));
+    sim->objRefs = RL_MALLOC(cfg->numObj * sizeof(propRef));
+    sim->fallen = RL_MALLOC(cfg->numObj * sizeof(int));
+    sim->held = RL_MALLOC(cfg->numObj * sizeof(int));
+    sim->touching = RL_CALLOC(cfg->numObj, sizeof(bool));
+    // not in a space, it's only ever collided with the ground
+    sim->groundRay = dCreateRay(0, 40);
+    for (int i = 0; i < cfg->numObj; i++) {
+        dBodyID body = sim->obj[i] = dBodyCreate(sim->world);
+        sim->objRefs[i] = (propRef){ sim, i, false };
+        dBodySetData(body, &sim->objRefs[i]);
+        dBodySetMovedCallback(body, propMoved);
+        dGeomID geom;
+        dMatrix3 R;
+        dMass m;
+        float typ = simRndf(sim, 0,1);
+        if (typ < .25) {                //  box
+            Vector3 s = (Vector3){simRndf(sim, 0.25, .5), simRndf(sim, 0.25, .5), simRndf(sim, 0.25, .5)};
+            geom = dCreateBox(sim->space, s.x, s.y, s.z);
+            dMassSetBox (&m, 10, s.x, s.y, s.z);
+        } else if (typ < .5) {          //  sphere
+            float r = simRndf(sim, 0.125, .25);
+            geom = dCreateSphere(sim->space, r);
+            dMassSetSphere(&m, 10, r);
+        } else if (typ < .75) {         //  cylinder
+            float l = simRndf(sim, 0.125, .5);
+            float r = simRndf(sim, 0.125, .5);
+            geom = dCreateCylinder(sim->space, r, l);
+            dMassSetCylinder(&m, 10, 3, r, l);
+        } else {                        //  composite of cylinder with 2 spheres
+            float l = simRndf(sim, .25,.5);
+            
+            geom = dCreateCylinder(sim->space, 0.125, l);
+            dGeomID geom2 = dCreateSphere(sim->space, l/2);
+            dGeomID geom3 = dCreateSphere(sim->space, l/2);
+
+            
+            dMass m2,m3;
+            dMassSetSphere(&m2, 5, l/2);
+            dMassTranslate(&m2,0, 0, l - 0.125);
+            dMassSetSphere(&m3, 5, l/2);
+            dMassTranslate(&m3,0, 0, -l + 0.125);
+            dMassSetCylinder(&m, 5, 3, .25, l);
+            dMassAdd(&m2, &m3);
+            dMassAdd(&m, &m2);
+            
+            dGeomSetBody(geom2, body);
+            dGeomSetBody(geom3, body);
+            createGeomInfo(geom2, true, MAT_PROP);
+            createGeomInfo(geom3, true, MAT_PROP);
+            dGeomSetOffsetPosition(geom2, 0, 0, l - 0.125);
+            dGeomSetOffsetPosition(geom3, 0, 0, -l + 0.125);
+
+        }
+
+        // give the body a random position and rotation
+        dBodySetPosition(body,
+                            simRand(sim) * 80 - 40, 4+(i/10), simRand(sim) * 80 - 40);
+        dRFromAxisAndAngle(R, simRand(sim) * 2.0 - 1.0,
+                            simRand(sim) * 2.0 - 1.0,
+                            simRand(sim) * 2.0 - 1.0,
+                            simRand(sim) * M_PI*2 - M_PI);
+        dBodySetRotation(body, R);
+        // set the bodies mass and the newly created geometry
+        dGeomSetBody(geom, body);
+        dBodySetMass(body, &m);
+        createGeomInfo(geom, true, MAT_PROP);
+    }
+    return sim;
+}
+
+// the obj loader gives 3 vertices per triangle, weld them
+// so the trimesh has shared vertices and proper indices
+simContext* createSim(const simConfig* cfg, Mesh groundMesh)
+{
+    float* verts;
+    int* ind;
+    int nV = weldMesh(groundMesh, &verts, &ind);
+    simContext* sim = createSimGround(cfg, verts, nV, ind, groundMesh.triangleCount * 3);
+    sim->ownsGround = true;
+    return sim;
+}
+
+void freeSim(simContext* sim)
+{
+    freeFleet(sim->fleet);
+    RL_FREE(sim->carFlipped);
+    RL_FREE(sim->carSpawn);
+    RL_FREE(sim->obj);
+    RL_FREE(sim->awake);
+    RL_FREE(sim->wasAwake);
+    RL_FREE(sim->objRefs);
+    RL_FREE(sim->fallen);
+    RL_FREE(sim->held);
+    RL_FREE(sim->touching);
+    dGeomDestroy(sim->groundRay);
+    
+    if (sim->tiles) freeTerrain(sim->tiles);
+    RL_FREE(sim->carCentres);
+    if (sim->ownsGround) {
+        RL_FREE((int*)sim->groundInd);
+        RL_FREE((float*)sim->groundVerts);
+    }
+    if (sim->triData) dGeomTriMeshDataDestroy(sim->triData);
+
+    dJointGroupEmpty(sim->contactgroup);
+    dJointGroupDestroy(sim->contactgroup);
+    freeSpaceGeomInfo(sim->space);
+    freeSpaceGeomInfo(sim->staticSpace);
+    if (sim->groundHf) freeHeightfield(sim->groundHf);
+    dSpaceDestroy(sim->space);
+    dSpaceDestroy(sim->staticSpace);
+    if (sim->threading) freePhysThreading(sim->threading, sim->world);
+    dWorldDestroy(sim->world);
+    RL_FREE(sim);
+}
+
+static int compareInt(const void* a, const void* b)
+{
+    return *(const int*)a - *(const int*)b;
+}
+
+static float distanceSq(const dReal* a, const dReal* b)
+{
+    float dx = a[0] - b[0], dy = a[1] - b[1], dz = a[2] - b[2];
+    return dx*dx + dy*dy + dz*dz;
+}
+
+typedef struct rayHit {
+    bool hit;
+    dReal y;
+} rayHit;
+
+static void rayCallback(void* data, dGeomID o1, dGeomID o2)
+{
+    rayHit* h = data;
+    dContactGeom cg;
+    if (dCollide(o1, o2, 1, &cg, sizeof(dContactGeom)) && (!h->hit || cg.pos[1] > h->y)) {
+        h->hit = true;
+        h->y = cg.pos[1];
+    }
+}
+
+// height of the ground under pos in the terms driveKinematicVehicle
+// wants, NAN when the tile under it isn't there yet
+static dReal groundUnder(simContext* sim, const dReal* pos)
+{
+    if (sim->tiles && !terrainResident(sim->tiles, pos[0], pos[2])) return NAN;
+    dGeomRaySet(sim->groundRay, pos[0], pos[1] + 10, pos[2], 0, -1, 0);
+    rayHit h = { false, 0 };
+    dSpaceCollide2(sim->groundRay, (dGeomID)sim->staticSpace, &h, rayCallback);
+    return h.hit ? h.y : -INFINITY;
+}
+
+// the game logic that touches the physics, run before each step
+void simGameStep(simContext* sim, const playerInput* in, simTimes* times)
+{
+    double t = getClock();
+    vehicleFleet* fleet = sim->fleet;
+    float physSlice = sim->cfg.physSlice;
+    if (sim->tiles) streamTerrain(sim, sim->cfg.terrainWait);
+    const dReal* focus = dBodyGetPosition(sim->car->bodies[0]);
+    float nearSq = sim->cfg.lodNear * sim->cfg.lodNear;
+    float farSq = sim->cfg.lodFar * sim->cfg.lodFar;
+    
+    for (int c = 0; c < fleet->count; c++) {
+        vehicle* v = &fleet->cars[c];
+        v->stepSize = physSlice;
+        
+        if (sim->cfg.lodFar > 0 && v != sim->car) {
+            float d = distanceSq(dBodyGetPosition(v->bodies[0]), focus);
+            if (!v->kinematic && d > farSq) {
+                setVehicleKinematic(v, true);
+                sim->kinematicCars++;
+            } else if (v->kinematic && d < nearSq) {
+                setVehicleKinematic(v, false);
+                sim->kinematicCars--;
+            }
+        }
+        
+        // count how many steps the car roll is >90 degrees either way
+        if (v->kinematic) {
+            sim->carFlipped[c]=0;   // it levels itself
+        } else if ( fabs(carRoll(v)) > (M_PI_2-0.001) ) {
+            sim->carFlipped[c]++;
+        } else {
+            sim->carFlipped[c]=0;
+        }
+
+        // if the car roll >90 degrees for a second and a half then flip it
+        if (sim->carFlipped[c] > 1.5 / physSlice) {
+            unflipVehicle(v);
+            sim->carFlipped[c] = 0;
+        }
+        
+        // the player drives the first car, the rest just weave about
+        if (v == sim->car) {
+            fleet->accel[c] = in->accel;
+            fleet->steer[c] = in->steer;
+        } else {
+            fleet->accel[c] = 20;
+            fleet->steer[c] = 0.4 * sinf(sim->tick * physSlice * 0.5 + c);
+        }
+        if (v->kinematic) {
+            driveKinematicVehicle(v, fleet->accel[c], fleet->steer[c],
+                                    groundUnder(sim, dBodyGetPosition(v->bodies[0])), physSlice);
+        }
+
+        const dReal* pos = dBodyGetPosition(v->bodies[0]);
+        if (pos[1]<-10) {
+            // back to where it started
+            restoreBodies(v->bodies, &sim->carSpawn[c * 6], 6);
+        }
+    }
+    updateFleet(fleet, 800.0, 10.0);
+
+    int numObj = sim->cfg.numObj;
+    if (in->space) {
+        for (int i = 0; i < numObj; i++) {
+            dBodyID body = sim->obj[i];
+            const dReal* pos = dBodyGetPosition(body);
+            // nothing under it to push it back down
+            if (sim->tiles && !terrainResident(sim->tiles, pos[0], pos[2])) continue;
+            // apply force if the space key is held
+            const dReal* v = dBodyGetLinearVel(sim->obj[0]);
+            if (v[1] < 10 && pos[1]<10) { // cap upwards velocity and don't let it get too high
+                dBodyEnable (body); // case its gone to sleep
+                dMass mass;
+                dBodyGetMass (body, &mass);
+                // give some object more force than others
+                // (tuned when this was applied once per 60Hz frame)
+                float f = (6+(((float)i/numObj)*4)) * mass.mass * physSlice * 60;
+                dBodyAddForce(body, simRndf(sim, -f,f), f*10, simRndf(sim, -f,f));
+            }
+        }
+    }
+
+    // only something that's moving can fall off the ground, islands
+    // stepped on other threads fill the awake list in any order so
+    // the teleports take their random numbers in prop order
+    int fallen = 0;
+    for (int i = 0; i < sim->awakeCount; i++) {
+        dBodyID body = sim->awake[i];
+        const dReal* pos = dBodyGetPosition(body);
+        if (pos[1]<-10) sim->fallen[fallen++] = ((propRef*)dBodyGetData(body))->index;
+    }
+    qsort(sim->fallen, fallen, sizeof(int), compareInt);
+    
+    // far from the player a prop that's slowed right down on something
+    // is put to sleep rather than waiting on the auto disable, which
+    // is tuned for what can be seen up close
+    if (sim->cfg.lodFar > 0) {
+        for (int i = 0; i < sim->awakeCount; i++) {
+            dBodyID body = sim->awake[i];
+            if (!sim->touching[((propRef*)dBodyGetData(body))->index]) continue;
+            if (distanceSq(dBodyGetPosition(body), focus) < farSq) continue;
+            const dReal* lv = dBodyGetLinearVel(body);
+            const dReal* av = dBodyGetAngularVel(body);
+            if (lv[0]*lv[0] + lv[1]*lv[1] + lv[2]*lv[2] < 0.25
+                    && av[0]*av[0] + av[1]*av[1] + av[2]*av[2] < 1) dBodyDisable(body);
+        }
+    }
+    for (int i = 0; i < fallen; i++) {
+        dBodyID body = sim->obj[sim->fallen[i]];
+        // teleport back if fallen off the ground
+        dBodySetPosition(body, simRand(sim) * 80 - 40,
+                                12 + simRndf(sim, 1,2), simRand(sim) * 80 - 40);
+        dBodySetLinearVel(body, 0, 0, 0);
+        dBodySetAngularVel(body, 0, 0, 0);
+    }
+    
+    // with nothing to land on a prop is held where it is until
+    // the ground under it is streamed in, then let go, the held
+    // list is kept in prop order so runs repeat
+    if (sim->tiles) {
+        int kept = 0;
+        for (int i = 0; i < sim->heldCount; i++) {
+            int p = sim->held[i];
+            const dReal* pos = dBodyGetPosition(sim->obj[p]);
+            if (terrainResident(sim->tiles, pos[0], pos[2])) {
+                sim->objRefs[p].held = false;
+                dBodyEnable(sim->obj[p]);
+            } else {
+                sim->held[kept++] = p;
+            }
+        }
+        sim->heldCount = kept;
+        
+        bool added = false;
+        for (int i = 0; i < sim->awakeCount; i++) {
+            const dReal* pos = dBodyGetPosition(sim->awake[i]);
+            if (terrainResident(sim->tiles, pos[0], pos[2])) continue;
+            dBodyDisable(sim->awake[i]);
+            propRef* ref = dBodyGetData(sim->awake[i]);
+            if (!ref->held) {
+                ref->held = true;
+                sim->held[sim->heldCount++] = ref->index;
+                added = true;
+            }
+        }
+        if (added) qsort(sim->held, sim->heldCount, sizeof(int), compareInt);
+    }
+    
+    times->game += getClock() - t;
+}
+
+// after a step only the geoms of bodies that moved have changed
+static void updateAwakeGeomStates(simContext* sim)
+{
+    for (int i = 0; i < sim->awakeCount; i++) updateBodyGeomStates(sim->awake[i]);
+    
+    // and the ones that stopped, so they settle on their last
+    // transform and show as asleep
+    for (int i = 0; i < sim->wasAwakeCount; i++) {
+        if (!dBodyIsEnabled(sim->wasAwake[i])) updateBodyGeomStates(sim->wasAwake[i]);
+    }
+    
+    // cars never sleep
+    for (int c = 0; c < sim->fleet->count; c++) {
+        for (int i = 0; i < 6; i++) {
+            dBodyID b = sim->fleet->cars[c].bodies[i];
+            if (b) updateBodyGeomStates(b);
+        }
+    }
+}
+
+void addCollideStats(collideStats* a, const collideStats* b)
+{
+    a->pairs += b->pairs;
+    a->connected += b->connected;
+    a->still += b->still;
+    for (int i = 0; i < COLLIDE_CLASSES; i++) {
+        for (int j = i; j < COLLIDE_CLASSES; j++) {
+            a->tests[i][j] += b->tests[i][j];
+            a->contacts[i][j] += b->contacts[i][j];
+            a->time[i][j] += b->time[i][j];
+        }
+    }
+}
+
+const char* geomClassName(int c)
+{
+    static const char* names[COLLIDE_CLASSES] = { "sphere", "box", "capsule", "cylinder", 
+                    "plane", "ray", "convex", "transform", "trimesh", "heightfield" };
+    return c >= 0 && c < COLLIDE_CLASSES ? names[c] : "other";
+}
+
+// one fixed time step, timings are added to times
+void simStep(simContext* sim, simTimes* times)
+{
+    // check for collisions, the context is passed through to the callback
+    // the ground never moves so it's only checked against everything else
+    double t = getClock();
+    if (sim->cfg.lodFar > 0) memset(sim->touching, 0, sim->cfg.numObj * sizeof(bool));
+    memset(&sim->collide, 0, sizeof(collideStats));
+    dSpaceCollide(sim->space, sim, &nearCallback);
+    dSpaceCollide2((dGeomID)sim->staticSpace, (dGeomID)sim->space, sim, &nearCallback);
+    addCollideStats(&sim->collideTotals, &sim->collide);
+    times->collide += getClock() - t;
+
+    // step the world, the moved callback refills the awake list
+    dBodyID* was = sim->wasAwake;
+    sim->wasAwake = sim->awake;
+    sim->wasAwakeCount = sim->awakeCount;
+    sim->awake = was;
+    sim->awakeCount = 0;
+    
+    t = getClock();
+    dWorldQuickStep(sim->world, sim->cfg.physSlice);  // NB fixed time step is important
+    times->step += getClock() - t;
+    
+    t = getClock();
+    dJointGroupEmpty(sim->contactgroup);
+    times->empty += getClock() - t;
+    
+    if (sim->rendering) updateAwakeGeomStates(sim);
+    sim->tick++;
+}
+
+
+typedef struct simRunner {
+    simContext** sims;
+    simTimes* times;
+    int count, steps;
+    simInputFunc input;
+    int next;   // the next context to be claimed
+} simRunner;
+
+// each worker claims whole contexts and runs them to the end, a world
+// is only ever touched by one thread so nothing needs locking
+static void* simWorker(void* arg)
+{
+    simRunner* run = arg;
+    dAllocateODEDataForThread(dAllocateMaskAll);
+    
+    int i;
+    while ((i = __atomic_fetch_add(&run->next, 1, __ATOMIC_RELAXED)) < run->count) {
+        simContext* sim = run->sims[i];
+        for (int s = 0; s < run->steps; s++) {
+            playerInput in = run->input(sim, s);
+            simGameStep(sim, &in, &run->times[i]);
+            simStep(sim, &run->times[i]);
+        }
+    }
+    
+    dCleanupODEAllDataForThread();
+    return 0;
+}
+
+// steps count independent contexts for steps each on a pool of threads
+// times gets the totals for each context, ODE has to be built with
+// --enable-ou for worlds on different threads to be safe
+void runSims(simContext** sims, int count, int steps, int threads,
+                simInputFunc input, simTimes* times)
+{
+    simRunner run = { sims, times, count, steps, input, 0 };
+    if (threads > count) threads = count;
+    pthread_t* pool = RL_MALLOC(threads * sizeof(pthread_t));
+    for (int i = 0; i < threads; i++) pthread_create(&pool[i], NULL, simWorker, &run);
+    for (int i = 0; i < threads; i++) pthread_join(pool[i], NULL);
+    RL_FREE(pool);
+}
+
+
+// a saved state is one flat buffer, everything that changes as the
+// world steps laid out one after the other, so restoring it is a
+// single pass over the bodies rather than building a new world
+typedef struct stateHeader {
+    unsigned long tick, rng, odeSeed;
+    int awakeCount, wasAwakeCount, heldCount;
+} stateHeader;
+
+// the wheel motors and what the car last set them to
+typedef struct carState {
+    dReal vel[4], fMax[4], vel2[4], fMax2[4];
+    int flipped;
+    bool driven;
+    float accel, driveTarget;
+    float fleetAccel, fleetSteer;
+    bool kinematic;
+    float speed, ride;
+    dReal rigPos[5][3];
+    dQuaternion rigQ[5];
+    float steerAngle, spin[4];
+} carState;
+
+static int stateBodies(const simContext* sim)
+{
+    return sim->cfg.numObj + sim->fleet->count * 6;
+}
+
+size_t simStateSize(const simContext* sim)
+{
+    return sizeof(stateHeader) + stateBodies(sim) * sizeof(bodyState)
+            + sim->fleet->count * sizeof(carState) 
+            + sim->cfg.numObj * 3 * sizeof(int)
+            + sim->cfg.numObj * sizeof(bool);
+}
+
+// between steps only, state must be simStateSize bytes
+void saveSimState(const simContext* sim, void* state)
+{
+    stateHeader* h = state;
+    bodyState* bodies = (bodyState*)(h + 1);
+    carState* cars = (carState*)(bodies + stateBodies(sim));
+    int* awake = (int*)(cars + sim->fleet->count);
+    int* wasAwake = awake + sim->cfg.numObj;
+    int* held = wasAwake + sim->cfg.numObj;
+    bool* touching = (bool*)(held + sim->cfg.numObj);
+    
+    *h = (stateHeader){ sim->tick, sim->rng, dRandGetSeed(), 
+                        sim->awakeCount, sim->wasAwakeCount, sim->heldCount };
+    saveBodies(sim->obj, bodies, sim->cfg.numObj);
+    bodies += sim->cfg.numObj;
+    
+    vehicleFleet* fleet = sim->fleet;
+    for (int c = 0; c < fleet->count; c++) {
+        vehicle* v = &fleet->cars[c];
+        saveBodies(v->bodies, &bodies[c * 6], 6);
+        carState* cs = &cars[c];
+        for (int j = 0; j < 4 && !v->params.raycast; j++) {
+            cs->vel[j] = dJointGetHinge2Param(v->joints[j], dParamVel);
+            cs->fMax[j] = dJointGetHinge2Param(v->joints[j], dParamFMax);
+            cs->vel2[j] = dJointGetHinge2Param(v->joints[j], dParamVel2);
+            cs->fMax2[j] = dJointGetHinge2Param(v->joints[j], dParamFMax2);
+        }
+        cs->flipped = sim->carFlipped[c];
+        cs->driven = v->driven;
+        cs->accel = v->accel;
+        cs->driveTarget = v->driveTarget;
+        cs->fleetAccel = fleet->accel[c];
+        cs->fleetSteer = fleet->steer[c];
+        cs->kinematic = v->kinematic;
+        cs->speed = v->speed;
+        cs->ride = v->ride;
+        memcpy(cs->rigPos, v->rigPos, sizeof(cs->rigPos));
+        memcpy(cs->rigQ, v->rigQ, sizeof(cs->rigQ));
+        cs->steerAngle = v->steerAngle;
+        memcpy(cs->spin, v->spin, sizeof(cs->spin));
+    }
+    
+    // the awake lists decide what can be teleported next step
+    for (int i = 0; i < sim->awakeCount; i++) {
+        awake[i] = ((propRef*)dBodyGetData(sim->awake[i]))->index;
+    }
+    for (int i = 0; i < sim->wasAwakeCount; i++) {
+        wasAwake[i] = ((propRef*)dBodyGetData(sim->wasAwake[i]))->index;
+    }
+    memcpy(held, sim->held, sim->heldCount * sizeof(int));
+    memcpy(touching, sim->touching, sim->cfg.numObj * sizeof(bool));
+}
+
+// the context must be the one the state was saved from, or one
+// created from the same config and ground
+// the bodies, cars and game state go back but ODE's space keeps its
+// geoms in the order they last moved and streamed tiles stay where
+// they are, so broadphase pairs can come out in another order and
+// stepping on from here is close to the original rather than exact
+void restoreSimState(simContext* sim, const void* state)
+{
+    const stateHeader* h = state;
+    const bodyState* bodies = (const bodyState*)(h + 1);
+    const carState* cars = (const carState*)(bodies + stateBodies(sim));
+    const int* awake = (const int*)(cars + sim->fleet->count);
+    const int* wasAwake = awake + sim->cfg.numObj;
+    const int* held = wasAwake + sim->cfg.numObj;
+    const bool* touching = (const bool*)(held + sim->cfg.numObj);
+    
+    sim->tick = h->tick;
+    sim->rng = h->rng;
+    dRandSetSeed(h->odeSeed);
+    restoreBodies(sim->obj, bodies, sim->cfg.numObj);
+    bodies += sim->cfg.numObj;
+    
+    vehicleFleet* fleet = sim->fleet;
+    sim->kinematicCars = 0;
+    for (int c = 0; c < fleet->count; c++) {
+        vehicle* v = &fleet->cars[c];
+        const carState* cs = &cars[c];
+        // switched before the bodies go back, switching takes the
+        // rig's shape from where the bodies are
+        setVehicleKinematic(v, cs->kinematic);
+        sim->kinematicCars += cs->kinematic;
+        restoreBodies(v->bodies, &bodies[c * 6], 6);
+        for (int j = 0; j < 4 && !v->params.raycast; j++) {
+            dJointSetHinge2Param(v->joints[j], dParamVel, cs->vel[j]);
+            dJointSetHinge2Param(v->joints[j], dParamFMax, cs->fMax[j]);
+            dJointSetHinge2Param(v->joints[j], dParamVel2, cs->vel2[j]);
+            dJointSetHinge2Param(v->joints[j], dParamFMax2, cs->fMax2[j]);
+        }
+        sim->carFlipped[c] = cs->flipped;
+        v->driven = cs->driven;
+        v->accel = cs->accel;
+        v->driveTarget = cs->driveTarget;
+        fleet->accel[c] = cs->fleetAccel;
+        fleet->steer[c] = cs->fleetSteer;
+        v->speed = cs->speed;
+        v->ride = cs->ride;
+        memcpy(v->rigPos, cs->rigPos, sizeof(v->rigPos));
+        memcpy(v->rigQ, cs->rigQ, sizeof(v->rigQ));
+        v->steerAngle = cs->steerAngle;
+        memcpy(v->spin, cs->spin, sizeof(v->spin));
+    }
+    
+    sim->awakeCount = h->awakeCount;
+    sim->wasAwakeCount = h->wasAwakeCount;
+    for (int i = 0; i < h->awakeCount; i++) sim->awake[i] = sim->obj[awake[i]];
+    for (int i = 0; i < h->wasAwakeCount; i++) sim->wasAwake[i] = sim->obj[wasAwake[i]];
+    for (int i = 0; i < sim->cfg.numObj; i++) sim->objRefs[i].held = false;
+    sim->heldCount = h->heldCount;
+    for (int i = 0; i < h->heldCount; i++) {
+        sim->held[i] = held[i];
+        sim->objRefs[held[i]].held = true;
+    }
+    memcpy(sim->touching, touching, sim->cfg.numObj * sizeof(bool));
+    
+    // contacts cached from the last step no longer apply
+    int ng = dSpaceGetNumGeoms(sim->staticSpace);
+    for (int i = 0; i < ng; i++) {
+        dGeomID g = dSpaceGetGeom(sim->staticSpace, i);
+        if (dGeomGetClass(g) == dTriMeshClass) dGeomTriMeshClearTCCache(g);
+    }
+    
+    // twice so nothing interpolates across the jump
+    if (sim->rendering) {
+        updateGeomStates(sim->space);
+        updateGeomStates(sim->space);
+    }
+}
+
+
+// fnv-1a over the position and rotation of every body, two
+// runs that end on the same checksum almost certainly matched
+static uint32_t hashBody(uint32_t h, dBodyID body)
+{
+    const unsigned char* p[2] = { (const unsigned char*)dBodyGetPosition(body),
+                                    (const unsigned char*)dBodyGetQuaternion(body) };
+    size_t n[2] = { 3 * sizeof(dReal), 4 * sizeof(dReal) };
+    for (int j = 0; j < 2; j++) {
+        for (size_t i = 0; i < n[j]; i++) {
+            h ^= p[j][i];
+            h *= 16777619u;
+        }
+    }
+    return h;
+}
+
+unsigned int simChecksum(const simContext* sim)
+{
+    uint32_t h = 2166136261u;
+    for (int i = 0; i < sim->cfg.numObj; i++) h = hashBody(h, sim->obj[i]);
+    for (int c = 0; c < sim->fleet->count; c++) {
+        for (int i = 0; i < 6; i++) {
+            dBodyID b = sim->fleet->cars[c].bodies[i];
+            if (b) h = hashBody(h, b);
+        }
+    }
+    return h;
+}
+
+
+// input logs are a header followed by one record per step, both
+// written as they are in memory so are only good on the same sort
+// of machine (and build) as they were recorded on
+#define LOG_MAGIC 0x564f4c52    // "RLOV"
+#define LOG_VERSION 4
+#define LOG_RECORD 9            // accel, steer and a flags byte
+
+typedef struct logHeader {
+    uint32_t magic, version;
+    uint32_t steps, checksum;   // filled in when the log is closed
+    uint32_t seed;
+    int32_t numObj, numCars, physThreads;
+    float physSlice;
+    int32_t groundPreprocess, groundHeightfield, heightfieldSamples;
+    int32_t broadphase, hashMinLevel, hashMaxLevel, quadTreeDepth;
+    int32_t terrainTiles;
+    float terrainRadius;
+    float lodNear, lodFar;
+    int32_t raycastCars;
+} logHeader;
+
+struct inputLog {
+    FILE* file;
+    logHeader header;
+};
+
+inputLog* createInputLog(const char* fileName, const simConfig* cfg)
+{
+    FILE* file = fopen(fileName, "wb");
+    if (!file) {
+        TraceLog(LOG_WARNING, "LOG: [%s] Failed to open input log", fileName);
+        return NULL;
+    }
+    inputLog* log = RL_MALLOC(sizeof(inputLog));
+    log->file = file;
+    log->header = (logHeader){
+        .magic = LOG_MAGIC, .version = LOG_VERSION,
+        .seed = cfg->seed,
+        .numObj = cfg->numObj, .numCars = cfg->numCars, .physThreads = cfg->physThreads,
+        .physSlice = cfg->physSlice,
+        .groundPreprocess = cfg->groundPreprocess, .groundHeightfield = cfg->groundHeightfield,
+        .heightfieldSamples = cfg->heightfieldSamples,
+        .broadphase = cfg->broadphase, .hashMinLevel = cfg->hashMinLevel,
+        .hashMaxLevel = cfg->hashMaxLevel, .quadTreeDepth = cfg->quadTreeDepth,
+        .terrainTiles = cfg->terrainTiles, .terrainRadius = cfg->terrainRadius,
+        .lodNear = cfg->lodNear, .lodFar = cfg->lodFar,
+        .raycastCars = cfg->raycastCars
+    };
+    fwrite(&log->header, sizeof(logHeader), 1, file);
+    return log;
+}
+
+// call with the input just before it's given to simGameStep
+void logInput(inputLog* log, const playerInput* in)
+{
+    unsigned char rec[LOG_RECORD];
+    memcpy(rec, &in->accel, 4);
+    memcpy(rec + 4, &in->steer, 4);
+    rec[8] = in->space;
+    fwrite(rec, LOG_RECORD, 1, log->file);
+    log->header.steps++;
+}
+
+// the final state goes in the header for a replay to check against,
+// returns the number of steps recorded
+int closeInputLog(inputLog* log, const simContext* sim)
+{
+    int steps = log->header.steps;
+    log->header.checksum = simChecksum(sim);
+    fseek(log->file, 0, SEEK_SET);
+    fwrite(&log->header, sizeof(logHeader), 1, log->file);
+    fclose(log->file);
+    RL_FREE(log);
+    return steps;
+}
+
+// reads a whole log, the config it was recorded with goes into cfg
+// (anything not in the header is left alone), NULL on failure
+playerInput* loadInputLog(const char* fileName, simConfig* cfg, int* steps, unsigned int* checksum)
+{
+    FILE* file = fopen(fileName, "rb");
+    if (!file) {
+        TraceLog(LOG_WARNING, "LOG: [%s] Failed to open input log", fileName);
+        return NULL;
+    }
+    logHeader h;
+    if (fread(&h, sizeof(logHeader), 1, file) != 1 || h.magic != LOG_MAGIC 
+            || h.version != LOG_VERSION || h.steps < 1 || h.numObj < 1 || h.numCars < 1
+            || h.physThreads < 1 || !(h.physSlice > 0)
+            || h.broadphase < BROAD_HASH || h.broadphase > BROAD_QUADTREE) {
+        TraceLog(LOG_WARNING, "LOG: [%s] Not a usable input log", fileName);
+        fclose(file);
+        return NULL;
+    }
+    
+    playerInput* in = RL_MALLOC(h.steps * sizeof(playerInput));
+    unsigned char rec[LOG_RECORD];
+    for (uint32_t i = 0; i < h.steps; i++) {
+        if (fread(rec, LOG_RECORD, 1, file) != 1) {
+            TraceLog(LOG_WARNING, "LOG: [%s] Input log is truncated", fileName);
+            RL_FREE(in);
+            fclose(file);
+            return NULL;
+        }
+        memcpy(&in[i].accel, rec, 4);
+        memcpy(&in[i].steer, rec + 4, 4);
+        in[i].space = rec[8];
+    }
+    fclose(file);
+    
+    cfg->seed = h.seed;
+    cfg->numObj = h.numObj;
+    cfg->numCars = h.numCars;
+    cfg->physThreads = h.physThreads;
+    cfg->physSlice = h.physSlice;
+    cfg->groundPreprocess = h.groundPreprocess;
+    cfg->groundHeightfield = h.groundHeightfield;
+    cfg->heightfieldSamples = h.heightfieldSamples;
+    cfg->broadphase = h.broadphase;
+    cfg->hashMinLevel = h.hashMinLevel;
+    cfg->hashMaxLevel = h.hashMaxLevel;
+    cfg->quadTreeDepth = h.quadTreeDepth;
+    cfg->terrainTiles = h.terrainTiles;
+    cfg->terrainRadius = h.terrainRadius;
+    cfg->lodNear = h.lodNear;
+    cfg->lodFar = h.lodFar;
+    cfg->raycastCars = h.raycastCars;
+    *steps = h.steps;
+    *checksum = h.checksum;
+    return in;
+}
+
+
+#define SCHED_SMOOTH 0.05       // weight of the newest step in the average
+#define SCHED_SETTLE 30         // steps for the average to see a change
+#define SCHED_SLICE 1.25f       // step size changes by this much at a time
+
+void initScheduler(stepScheduler* s, const simContext* sim, int minIterations, float maxSlice, float headroom)
+{
+    s->headroom = headroom;
+    s->cost = 0;
+    s->maxIterations = dWorldGetQuickStepNumIterations(sim->world);
+    s->minIterations = Clamp(minIterations, 1, s->maxIterations);
+    s->iterations = s->maxIterations;
+    s->baseSlice = sim->cfg.physSlice;
+    s->maxSlice = fmaxf(maxSlice, s->baseSlice);
+    s->settle = SCHED_SETTLE;
+    s->degraded = false;
+}
+
+// cost is the real time the step just taken needed, called after each
+// step by whichever thread steps the sim
+void scheduleStep(stepScheduler* s, simContext* sim, double cost)
+{
+    s->cost += (s->cost > 0 ? SCHED_SMOOTH : 1.0) * (cost - s->cost);
+    if (--s->settle > 0) return;
+    s->settle = SCHED_SETTLE;
+
+    float slice = sim->cfg.physSlice;
+    double load = s->cost / (slice * s->headroom);
+    if (load > 1) {
+        if (s->iterations > s->minIterations) {
+            // the solver is most of the step and its cost goes with
+            // the iterations, collision doesn't so this undershoots
+            int it = s->iterations / load;
+            s->iterations = Clamp(it, s->minIterations, s->iterations - 1);
+        } else if (slice < s->maxSlice) {
+            slice = fminf(slice * SCHED_SLICE, s->maxSlice);
+        } else {
+            return;     // nothing left to give, real time will slip
+        }
+    } else if (load < 0.7) {
+        // a shorter step has less time so it goes back first, with
+        // enough room below 1 to not bounce straight back
+        if (slice > s->baseSlice) {
+            slice = fmaxf(slice / SCHED_SLICE, s->baseSlice);
+        } else if (s->iterations < s->maxIterations) {
+            s->iterations++;
+        } else {
+            return;
+        }
+    } else {
+        return;
+    }
+
+    dWorldSetQuickStepNumIterations(sim->world, s->iterations);
+    sim->cfg.physSlice = slice;
+
+    bool degraded = s->iterations < s->maxIterations || slice > s->baseSlice;
+    if (degraded != s->degraded) {
+        if (degraded) {
+            TraceLog(LOG_WARNING, "SIM: Step cost %.2f ms, trading accuracy for real time", s->cost * 1000);
+        } else {
+            TraceLog(LOG_INFO, "SIM: Back to full accuracy");
+        }
+    }
+    s->degraded = degraded;
+}
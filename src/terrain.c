@@ -0,0 +1,250 @@
+/*
+ * Copyright (c) 2021 Chris Camacho (codifies -  http://bedroomcoders.co.uk/)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include "raylib.h"
+#include "raymath.h"
+
+#include <ode/ode.h>
+#include "raylibODE.h"
+#include "terrain.h"
+
+#include <float.h>
+#include <stdlib.h>
+
+
+// builds the collision data for one tile at a time, the slow part
+// is ODE building the tile's AABB tree and edge data
+static void* terrainLoader(void* arg)
+{
+    terrain* t = arg;
+    dAllocateODEDataForThread(dAllocateMaskAll);
+    
+    pthread_mutex_lock(&t->lock);
+    while (!t->quit) {
+        if (!t->queued) {
+            pthread_cond_wait(&t->wake, &t->lock);
+            continue;
+        }
+        terrainTile* tile = &t->tiles[t->queue[--t->queued]];
+        pthread_mutex_unlock(&t->lock);
+        
+        dTriMeshDataID data = dGeomTriMeshDataCreate();
+        dGeomTriMeshDataBuildSingle(data, t->verts, 3 * sizeof(float), t->nV,
+                                    tile->ind, tile->nI, 3 * sizeof(int));
+        if (t->preprocess) {
+            // face angles let ODE drop contacts on internal edges
+            dGeomTriMeshDataPreprocess2(data, 
+                        (1U << dTRIDATAPREPROCESS_BUILD_FACE_ANGLES), NULL);
+        }
+        
+        pthread_mutex_lock(&t->lock);
+        tile->data = data;
+        tile->state = TILE_BUILT;
+        t->building--;
+        pthread_cond_broadcast(&t->built);
+    }
+    pthread_mutex_unlock(&t->lock);
+    
+    dCleanupODEAllDataForThread();
+    return 0;
+}
+
+// each triangle goes to the tile its centre is in, so tiles don't
+// overlap but their extents can poke a little into their neighbours
+terrain* createTerrain(const float* verts, int nV, const int* ind, int nI,
+                        int side, bool preprocess)
+{
+    terrain* t = RL_CALLOC(1, sizeof(terrain));
+    t->verts = verts;
+    t->nV = nV;
+    t->side = side;
+    t->preprocess = preprocess;
+    
+    float maxX = -FLT_MAX, maxZ = -FLT_MAX;
+    t->minX = t->minZ = FLT_MAX;
+    for (int i = 0; i < nV; i++) {
+        t->minX = fminf(t->minX, verts[i * 3]);
+        t->minZ = fminf(t->minZ, verts[i * 3 + 2]);
+        maxX = fmaxf(maxX, verts[i * 3]);
+        maxZ = fmaxf(maxZ, verts[i * 3 + 2]);
+    }
+    // a touch bigger so the far edge is still in the last tile
+    t->tileSize = fmaxf(maxX - t->minX, maxZ - t->minZ) / side * 1.0001f;
+    
+    int count = side * side;
+    int nT = nI / 3;
+    int* owner = RL_MALLOC(nT * sizeof(int));
+    t->tiles = RL_CALLOC(count, sizeof(terrainTile));
+    for (int i = 0; i < nT; i++) {
+        const int* tri = &ind[i * 3];
+        float cx = 0, cz = 0;
+        for (int j = 0; j < 3; j++) {
+            cx += verts[tri[j] * 3] / 3;
+            cz += verts[tri[j] * 3 + 2] / 3;
+        }
+        int tx = Clamp((cx - t->minX) / t->tileSize, 0, side - 1);
+        int tz = Clamp((cz - t->minZ) / t->tileSize, 0, side - 1);
+        owner[i] = tz * side + tx;
+        t->tiles[owner[i]].nI += 3;
+    }
+    
+    for (int i = 0; i < count; i++) {
+        terrainTile* tile = &t->tiles[i];
+        tile->ind = RL_MALLOC((tile->nI ? tile->nI : 1) * sizeof(int));
+        tile->nI = 0;
+        tile->minX = tile->minZ = FLT_MAX;
+        tile->maxX = tile->maxZ = -FLT_MAX;
+    }
+    for (int i = 0; i < nT; i++) {
+        terrainTile* tile = &t->tiles[owner[i]];
+        for (int j = 0; j < 3; j++) {
+            int v = ind[i * 3 + j];
+            tile->ind[tile->nI++] = v;
+            tile->minX = fminf(tile->minX, verts[v * 3]);
+            tile->minZ = fminf(tile->minZ, verts[v * 3 + 2]);
+            tile->maxX = fmaxf(tile->maxX, verts[v * 3]);
+            tile->maxZ = fmaxf(tile->maxZ, verts[v * 3 + 2]);
+        }
+    }
+    RL_FREE(owner);
+    
+    t->queue = RL_MALLOC(count * sizeof(int));
+    pthread_mutex_init(&t->lock, NULL);
+    pthread_cond_init(&t->wake, NULL);
+    pthread_cond_init(&t->built, NULL);
+    pthread_create(&t->thread, NULL, terrainLoader, t);
+    return t;
+}
+
+// how far a point is from a tile on the ground plane
+static float tileDistance(const terrainTile* tile, const Vector3* centres, int count)
+{
+    float best = FLT_MAX;
+    for (int i = 0; i < count; i++) {
+        float dx = fmaxf(fmaxf(tile->minX - centres[i].x, centres[i].x - tile->maxX), 0);
+        float dz = fmaxf(fmaxf(tile->minZ - centres[i].z, centres[i].z - tile->maxZ), 0);
+        best = fminf(best, dx * dx + dz * dz);
+    }
+    return sqrtf(best);
+}
+
+static void dropTile(terrain* t, terrainTile* tile)
+{
+    if (tile->geom) {
+        RL_FREE(dGeomGetData(tile->geom));
+        dGeomDestroy(tile->geom);
+        tile->geom = 0;
+        t->resident--;
+    }
+    if (tile->data) dGeomTriMeshDataDestroy(tile->data);
+    tile->data = 0;
+    tile->state = TILE_UNLOADED;
+}
+
+// call between steps with where the cars are, tiles within radius are
+// queued to be built and those well clear of every car are dropped,
+// with wait it blocks until the tiles in range are built so what's
+// resident doesn't depend on how quick the loader thread was
+void updateTerrain(terrain* t, dSpaceID space, const Vector3* centres, int count,
+                        float radius, bool wait)
+{
+    // leave some slack so a car on a tile edge doesn't thrash it
+    float keep = radius + t->tileSize;
+    int tiles = t->side * t->side;
+    
+    pthread_mutex_lock(&t->lock);
+    for (int i = 0; i < tiles; i++) {
+        terrainTile* tile = &t->tiles[i];
+        if (!tile->nI) continue;
+        float d = tileDistance(tile, centres, count);
+        if (tile->state == TILE_UNLOADED && d < radius) {
+            tile->state = TILE_BUILDING;
+            t->queue[t->queued++] = i;
+            t->building++;
+            pthread_cond_signal(&t->wake);
+        } else if (tile->state == TILE_RESIDENT && d > keep) {
+            dropTile(t, tile);
+        }
+    }
+    if (wait) {
+        while (t->building) pthread_cond_wait(&t->built, &t->lock);
+    }
+    
+    for (int i = 0; i < tiles; i++) {
+        terrainTile* tile = &t->tiles[i];
+        if (tile->state != TILE_BUILT) continue;
+        if (tileDistance(tile, centres, count) > keep) {
+            // moved away while it was being built
+            dropTile(t, tile);
+            continue;
+        }
+        tile->geom = dCreateTriMesh(space, tile->data, NULL, NULL, NULL);
+        createGeomInfo(tile->geom, true, MAT_GROUND);
+        if (t->preprocess) {
+            // reuse last step's results for the shapes that support it
+            dGeomTriMeshEnableTC(tile->geom, dSphereClass, 1);
+            dGeomTriMeshEnableTC(tile->geom, dBoxClass, 1);
+        }
+        tile->state = TILE_RESIDENT;
+        t->resident++;
+    }
+    pthread_mutex_unlock(&t->lock);
+}
+
+// true if the ground at and around a point is in the space, or
+// there's no ground there to have
+bool terrainResident(const terrain* t, float x, float z)
+{
+    int cx = floorf((x - t->minX) / t->tileSize);
+    int cz = floorf((z - t->minZ) / t->tileSize);
+    // the neighbours too as triangles overhang their tile's edge
+    for (int j = cz - 1; j <= cz + 1; j++) {
+        for (int i = cx - 1; i <= cx + 1; i++) {
+            if (i < 0 || j < 0 || i >= t->side || j >= t->side) continue;
+            const terrainTile* tile = &t->tiles[j * t->side + i];
+            if (tile->nI && !tile->geom) return false;
+        }
+    }
+    return true;
+}
+
+// before the space the tiles are in is destroyed
+void freeTerrain(terrain* t)
+{
+    pthread_mutex_lock(&t->lock);
+    t->quit = true;
+    pthread_cond_signal(&t->wake);
+    pthread_mutex_unlock(&t->lock);
+    pthread_join(t->thread, NULL);
+    
+    for (int i = 0; i < t->side * t->side; i++) {
+        dropTile(t, &t->tiles[i]);
+        RL_FREE(t->tiles[i].ind);
+    }
+    pthread_cond_destroy(&t->built);
+    pthread_cond_destroy(&t->wake);
+    pthread_mutex_destroy(&t->lock);
+    RL_FREE(t->queue);
+    RL_FREE(t->tiles);
+    RL_FREE(t);
+}